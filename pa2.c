@@ -19,6 +19,15 @@
 #include <string.h>
 #include <inttypes.h>
 #include <ctype.h>
+#include <time.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#endif
 
 /*====================================================================*/
 /*          ****** DO NOT MODIFY ANYTHING FROM THIS LINE ******       */
@@ -39,9 +48,10 @@ const char *__color_start = "[1;32;40m";
 const char *__color_end = "[0m";
 
 /**
- * memory[] emulates the memory of the machine
+ * initial_memory[] is the initial contents of the memory of the machine
+ * from 0x0000 0000. The memory itself is emulated by struct guest_memory below
  */
-static unsigned char memory[1 << 20] = {	/* 1MB memory at 0x0000 0000 -- 0x0100 0000 */
+static const unsigned char initial_memory[] = {
 	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
 	0xde, 0xad, 0xbe, 0xef, 0x00, 0x00, 0x00, 0x00,
 	'h',  'e',  'l',  'l',  'o',  ' ',  'w',  'o',
@@ -56,9 +66,9 @@ static unsigned char memory[1 << 20] = {	/* 1MB memory at 0x0000 0000 -- 0x0100
 #define INITIAL_SP	0x8000	/* Initial location for stack pointer */
 
 /**
- * Registers of the machine
+ * Initial values of the registers of the machine
  */
-static unsigned int registers[32] = {
+static const unsigned int initial_registers[32] = {
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0,
 	0x10, INITIAL_PC, 0x20, 3, 0xbadacafe, 0xcdcdcdcd, 0xffffffff, 7,
@@ -75,11 +85,6 @@ const char *register_names[] = {
 	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
 };
 
-/**
- * Program counter register
- */
-static unsigned int pc = INITIAL_PC;
-
 /**
  * strmatch()
  *
@@ -100,416 +105,4114 @@ static inline bool strmatch(char * const str, const char *expect)
 /*====================================================================*/
 
 /**********************************************************************
- * process_instruction
+ * Guest memory
  *
  * DESCRIPTION
- *   Execute the machine code given through @instr. The following table lists
- *   up the instructions to support. Note that a pseudo instruction 'halt'
- *   (0xffffffff) is added for the testing purpose. Also '*' instrunctions are
- *   the ones that are newly added to PA2.
+ *   struct guest_memory emulates the whole 32-bit address space of a machine with
+ *   4 KB pages. The pages are found through a two-level page table; the
+ *   upper 10 bits of an address index @directory, and the next 10 bits index
+ *   the page table it points to. Both the page tables and the pages are
+ *   allocated when they are written for the first time, so programs with
+ *   large but sparse footprints only consume the memory they touch. Reading
+ *   a page never written returns zeroes.
  *
- * | Name   | Format    | Opcode / opcode + funct |
- * | ------ | --------- | ----------------------- |
- * | `add`  | r-format  | 0 + 0x20                |
- * | `addi` | i-format  | 0x08                    |
- * | `sub`  | r-format  | 0 + 0x22                |
- * | `and`  | r-format  | 0 + 0x24                |
- * | `andi` | i-format  | 0x0c                    |
- * | `or`   | r-format  | 0 + 0x25                |
- * | `ori`  | i-format  | 0x0d                    |
- * | `nor`  | r-format  | 0 + 0x27                |
- * | `sll`  | r-format  | 0 + 0x00                |
- * | `srl`  | r-format  | 0 + 0x02                |
- * | `sra`  | r-format  | 0 + 0x03                |
- * | `lw`   | i-format  | 0x23                    |
- * | `sw`   | i-format  | 0x2b                    |
- * | `slt`  | r-format* | 0 + 0x2a                |
- * | `slti` | i-format* | 0x0a                    |
- * | `beq`  | i-format* | 0x04                    |
- * | `bne`  | i-format* | 0x05                    |
- * | `jr`   | r-format* | 0 + 0x08                |
- * | `j`    | j-format* | 0x02                    |
- * | `jal`  | j-format* | 0x03                    |
- * | `halt` | special*  | @instr == 0xffffffff    |
+ *   The last pages read and written are cached in @read_page and
+ *   @write_page like a TLB, so that consecutive accesses to the same page
+ *   skip the page table walk.
  *
- * RETURN VALUE
- *   1 if successfully processed the instruction.
- *   0 if @instr is 'halt' or unknown instructions
+ *   Writing fails when a page cannot be allocated or @max_pages pages are
+ *   already in use, and fetching an instruction from a page never written
+ *   fails as well. The failure is recorded in @faulted and @fault_addr, and
+ *   the program is stopped at the faulting instruction.
  */
-static int process_instruction(unsigned int instr)
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1 << PAGE_SHIFT)
+#define NR_PTES			(1 << 10)	/* Entries in a level of the page table */
+
+struct guest_memory {
+	unsigned char **directory[NR_PTES];
+
+	unsigned int read_vpn;		/* Page number of @read_page */
+	unsigned char *read_page;
+	unsigned int write_vpn;		/* Page number of @write_page */
+	unsigned char *write_page;
+
+	unsigned long nr_pages;		/* Number of pages in use */
+	unsigned long max_pages;	/* Limit of @nr_pages. 0 for no limit */
+
+	bool faulted;
+	unsigned int fault_addr;
+};
+
+/**********************************************************************
+ * mem_lookup(mem, addr, alloc)
+ *
+ * DESCRIPTION
+ *   Walk the page table of @mem to find the page containing @addr. If the
+ *   page is not there and @alloc is true, allocate the page.
+ *
+ * RETURN
+ *   The page containing @addr
+ *   NULL if the page does not exist and cannot be allocated
+ */
+static unsigned char *mem_lookup(struct guest_memory *mem, unsigned int addr, bool alloc)
 {
-	int opcode = instr / (1 << 26);
+	unsigned int vpn = addr >> PAGE_SHIFT;
+	unsigned char **table = mem->directory[vpn / NR_PTES];
+	unsigned char *page;
 
-	//r-instruction
-	if(opcode == 0)
+	if(table == NULL)
 	{
-		int rs, rt, rd, shamt, funct;
+		if(!alloc)
+			return NULL;
+		table = calloc(NR_PTES, sizeof(*table));
+		if(table == NULL)
+			return NULL;
+		mem->directory[vpn / NR_PTES] = table;
+	}
 
-		funct = instr % (1 << 6);
-		instr = instr / (1 << 6);
+	page = table[vpn % NR_PTES];
+	if(page == NULL)
+	{
+		if(!alloc)
+			return NULL;
+		if(mem->max_pages && mem->nr_pages >= mem->max_pages)
+			return NULL;
+		page = calloc(PAGE_SIZE, 1);
+		if(page == NULL)
+			return NULL;
+		table[vpn % NR_PTES] = page;
+		mem->nr_pages++;
+	}
+	return page;
+}
 
-		shamt = instr % (1 << 5);
-		instr = instr / (1 << 5);
+static inline const unsigned char *mem_read_page(struct guest_memory *mem, unsigned int addr)
+{
+	unsigned char *page;
 
-		rd = instr % (1 << 5);
-		instr = instr / (1 << 5);
+	if((addr >> PAGE_SHIFT) == mem->read_vpn && mem->read_page)
+		return mem->read_page;
 
-		rt = instr % (1 << 5);
-		instr = instr / (1 << 5);
+	page = mem_lookup(mem, addr, false);
+	if(page)
+	{
+		mem->read_vpn = addr >> PAGE_SHIFT;
+		mem->read_page = page;
+	}
+	return page;
+}
 
-		rs = instr % (1 << 5);
-		instr = instr / (1 << 5);
-		
-		if(funct == 0x20)		//add
-		{
-			registers[rd] = (registers[rs] + registers[rt]);
-			printf("rs + rt = rd\t %x + %x = %x\n", registers[rs], registers[rt], registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x22)	//sub
-		{
-			registers[rd] = registers[rs] - registers[rt];
-			printf("rs - rt = rd\t %x - %x = %x\n", registers[rs], registers[rt], registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x24) //and
-		{
-			registers[rd] = registers[rs] & registers[rt];
-			printf("rs & rt = rd\t %x & %x = %x\n", registers[rs], registers[rt], registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x25) //or
-		{
-			registers[rd] = registers[rs] | registers[rt];
-			printf("rs | rt = rd\t %x | %x = %x\n", registers[rs], registers[rt], registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x27) //nor
-		{
-			registers[rd] = ~(registers[rs] | registers[rt]);
-			printf("rs nor rt = rd\t %x nor %x =  %x\n", registers[rs], registers[rt], registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x00) //sll
+static inline unsigned char *mem_write_page(struct guest_memory *mem, unsigned int addr)
+{
+	unsigned char *page;
+
+	if((addr >> PAGE_SHIFT) == mem->write_vpn && mem->write_page)
+		return mem->write_page;
+
+	page = mem_lookup(mem, addr, true);
+	if(page == NULL)
+	{
+		mem->faulted = true;
+		mem->fault_addr = addr;
+		return NULL;
+	}
+	mem->write_vpn = addr >> PAGE_SHIFT;
+	mem->write_page = page;
+	return page;
+}
+
+static inline unsigned char mem_read_byte(struct guest_memory *mem, unsigned int addr)
+{
+	const unsigned char *page = mem_read_page(mem, addr);
+
+	return page ? page[addr % PAGE_SIZE] : 0;
+}
+
+static inline int mem_write_byte(struct guest_memory *mem, unsigned int addr, unsigned char byte)
+{
+	unsigned char *page = mem_write_page(mem, addr);
+
+	if(page == NULL)
+		return -1;
+	page[addr % PAGE_SIZE] = byte;
+	return 0;
+}
+
+/**********************************************************************
+ * Word access to the guest memory
+ *
+ * DESCRIPTION
+ *   The machine is big-endian. Rather than assembling a word byte by byte,
+ *   mem_read_word() and mem_write_word() access an aligned word at once
+ *   and convert it from/to the host byte order with a byte-swap intrinsic.
+ *   Unaligned words fall back to the byte-by-byte access. Aligned words
+ *   never cross a page boundary.
+ *
+ *   mem_write_word() returns 0 on success and -1 on a memory fault.
+ */
+#if defined(__GNUC__)
+#define bswap32(x)	__builtin_bswap32(x)
+#elif defined(_MSC_VER)
+#define bswap32(x)	_byteswap_ulong(x)
+#else
+static inline unsigned int bswap32(unsigned int x)
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+#endif
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define be32_to_host(x)	(x)
+#define host_to_be32(x)	(x)
+#else
+#define be32_to_host(x)	bswap32(x)
+#define host_to_be32(x)	bswap32(x)
+#endif
+
+static inline unsigned int mem_read_word(struct guest_memory *mem, unsigned int addr)
+{
+	unsigned int word;
+
+	if((addr % WORD_SIZE) == 0)
+	{
+		const unsigned char *page = mem_read_page(mem, addr);
+
+		if(page == NULL)
+			return 0;
+		memcpy(&word, &page[addr % PAGE_SIZE], WORD_SIZE);
+		return be32_to_host(word);
+	}
+
+	word = 0;
+	for(int i = 0; i < WORD_SIZE; i++)
+	{
+		word = (word << 8) | mem_read_byte(mem, addr + i);
+	}
+	return word;
+}
+
+static inline int mem_write_word(struct guest_memory *mem, unsigned int addr, unsigned int word)
+{
+	if((addr % WORD_SIZE) == 0)
+	{
+		unsigned char *page = mem_write_page(mem, addr);
+
+		if(page == NULL)
+			return -1;
+		word = host_to_be32(word);
+		memcpy(&page[addr % PAGE_SIZE], &word, WORD_SIZE);
+		return 0;
+	}
+
+	for(int i = WORD_SIZE - 1; i >= 0; i--)
+	{
+		if(mem_write_byte(mem, addr + i, word & 0xff))
+			return -1;
+		word >>= 8;
+	}
+	return 0;
+}
+
+/**********************************************************************
+ * mem_write_bytes(mem, addr, bytes, length)
+ *
+ * DESCRIPTION
+ *   Copy @length bytes from @bytes to [@addr, @addr + @length) of @mem,
+ *   a page at a time.
+ *
+ * RETURN
+ *   0 on success, -1 on a memory fault
+ */
+static int mem_write_bytes(struct guest_memory *mem, unsigned int addr, const unsigned char *bytes, size_t length)
+{
+	while(length > 0)
+	{
+		unsigned char *page = mem_write_page(mem, addr);
+		size_t chunk = PAGE_SIZE - addr % PAGE_SIZE;
+
+		if(page == NULL)
+			return -1;
+		if(chunk > length)
+			chunk = length;
+
+		memcpy(&page[addr % PAGE_SIZE], bytes, chunk);
+		addr += chunk;
+		bytes += chunk;
+		length -= chunk;
+	}
+	return 0;
+}
+
+/**********************************************************************
+ * mem_init(mem)
+ *
+ * DESCRIPTION
+ *   Initialize @mem with @initial_memory.
+ */
+static void mem_init(struct guest_memory *mem)
+{
+	mem->read_vpn = mem->write_vpn = ~0U;
+
+	for(unsigned int i = 0; i < sizeof(initial_memory); i++)
+	{
+		mem_write_byte(mem, i, initial_memory[i]);
+	}
+}
+
+/**********************************************************************
+ * mem_fini(mem)
+ *
+ * DESCRIPTION
+ *   Release all the pages and page tables of @mem.
+ */
+static void mem_fini(struct guest_memory *mem)
+{
+	for(int i = 0; i < NR_PTES; i++)
+	{
+		if(mem->directory[i] == NULL)
+			continue;
+		for(int j = 0; j < NR_PTES; j++)
 		{
-			registers[rd] = registers[rt] << shamt;
-			printf("sll // rt << shamt = rd\t %x << %x =  %x\n", registers[rt], shamt, registers[rd]);
-			return 1;
+			free(mem->directory[i][j]);
 		}
-		else if(funct == 0x02) //srl
+		free(mem->directory[i]);
+		mem->directory[i] = NULL;
+	}
+	mem->nr_pages = 0;
+	mem->read_page = mem->write_page = NULL;
+	mem->read_vpn = mem->write_vpn = ~0U;
+}
+
+/**********************************************************************
+ * Pre-decoded instructions
+ *
+ * DESCRIPTION
+ *   Reassembling an instruction from @memory and extracting its fields on
+ *   every execution dominates the time spent in loops. Instead, each word
+ *   of the text region is decoded once when the program is loaded, and
+ *   @run_program() executes the pre-decoded records in @text_decoded.
+ *   Whenever 'sw' writes into the text region, the overwritten words are
+ *   decoded again so that the records never go stale.
+ */
+enum instruction_ops {
+	OP_INVALID = 0,	/* Unknown instruction. Stops the program */
+	OP_ADD,
+	OP_ADDI,
+	OP_SUB,
+	OP_AND,
+	OP_ANDI,
+	OP_OR,
+	OP_ORI,
+	OP_NOR,
+	OP_SLL,
+	OP_SRL,
+	OP_SRA,
+	OP_LW,
+	OP_SW,
+	OP_SLT,
+	OP_SLTI,
+	OP_BEQ,
+	OP_BNE,
+	OP_JR,
+	OP_J,
+	OP_JAL,
+	OP_HALT,
+	NR_OPS,
+};
+
+static const char * const op_names[NR_OPS] = {
+	"invalid", "add", "addi", "sub", "and", "andi", "or", "ori", "nor",
+	"sll", "srl", "sra", "lw", "sw", "slt", "slti", "beq", "bne", "jr",
+	"j", "jal", "halt",
+};
+
+struct decoded_instr {
+	unsigned int instr;		/* Raw machine code */
+	unsigned int pc;		/* Address of the instruction */
+	unsigned char op;		/* Handler index. One of OP_* above */
+	unsigned char rs, rt, rd, shamt;
+	unsigned int imm;		/* Zero-extended 16-bit immediate */
+	unsigned int simm;		/* Sign-extended 16-bit immediate */
+	unsigned int target;	/* Jump target within the 256MB region (address << 2) */
+};
+
+/**********************************************************************
+ * Basic block cache
+ *
+ * DESCRIPTION
+ *   A basic block is a straight-line run of the decoded records which ends
+ *   at the first 'beq', 'bne', 'j', 'jal', 'jr', or 'halt'. @run_blocks(m)
+ *   translates a block once when the block is entered for the first time,
+ *   and keeps it in @text_blocks[] at the slot for its starting address.
+ *   Since the records of a block are the ones in @text_decoded, a block only
+ *   needs to know where it begins and where it ends.
+ *
+ *   Each block remembers the blocks it has transferred to (@next) so that
+ *   the successors can be entered without looking them up again. When 'sw'
+ *   overwrites the text region, the blocks containing the overwritten words
+ *   are invalidated. The links pointing to them are kept since they refer to
+ *   the slots; the invalidated blocks are translated again on the next entry.
+ */
+struct basic_block {
+	bool valid;
+	const struct decoded_instr *first;	/* The first record of the block */
+	const struct decoded_instr *last;	/* The branch or jump ending the block */
+	struct basic_block *next[2];		/* Successors linked so far */
+};
+
+/* Instructions ending a basic block */
+static const bool is_block_end[NR_OPS] = {
+	[OP_INVALID] = true,
+	[OP_BEQ] = true,
+	[OP_BNE] = true,
+	[OP_JR] = true,
+	[OP_J] = true,
+	[OP_JAL] = true,
+	[OP_HALT] = true,
+};
+
+/* Why a run has stopped */
+enum stop_reasons {
+	STOP_HALT = 0,	/* 'halt', an invalid instruction, or a memory fault */
+	STOP_LIMIT,		/* Retired @max_instructions */
+	STOP_TIMEOUT,	/* Ran for @max_seconds */
+};
+
+/**********************************************************************
+ * Machine
+ *
+ * DESCRIPTION
+ *   Everything a running program can see or change. Each instance of the
+ *   machine runs on its own, so several programs can run at the same time
+ *   (see 'batch' command). The command interpreter works on @machine.
+ */
+struct machine {
+	unsigned int registers[32];
+	unsigned int pc;				/* Program counter register */
+	struct guest_memory memory;
+
+	/* Decoded records and basic blocks for [@text_start, @text_end) */
+	struct decoded_instr *text_decoded;
+	struct basic_block *text_blocks;
+	unsigned int text_start;
+	unsigned int text_end;
+
+	unsigned int entry_pc;	/* Where the program starts */
+
+	struct profile *profile;	/* Execution profile. NULL if not profiling */
+	struct pipeline *pipeline;	/* Pipeline model. NULL if not timing */
+	struct predictor *predictor;	/* Branch predictor. NULL if not predicting */
+	struct ooo *ooo;				/* Out-of-order model. NULL if not timing */
+
+	/* Limits of a run. 0 for no limit (see 'limit' command) */
+	unsigned long long max_instructions;
+	double max_seconds;
+	struct timespec started;	/* When the run started */
+	int stopped;				/* Why the run stopped. One of STOP_* */
+};
+
+static struct machine machine;
+
+static void profile_free(struct machine *m);
+static void predictor_free(struct machine *m);
+static void ooo_free(struct machine *m);
+
+/**********************************************************************
+ * machine_init(m)
+ *
+ * DESCRIPTION
+ *   Reset @m to the initial state; @initial_registers, @initial_memory, and
+ *   no program loaded.
+ */
+static void machine_init(struct machine *m)
+{
+	memset(m, 0x00, sizeof(*m));
+	memcpy(m->registers, initial_registers, sizeof(m->registers));
+	m->pc = INITIAL_PC;
+	m->text_start = m->text_end = INITIAL_PC;
+	m->entry_pc = INITIAL_PC;
+	mem_init(&m->memory);
+}
+
+/**********************************************************************
+ * machine_fini(m)
+ *
+ * DESCRIPTION
+ *   Release the resources held by @m.
+ */
+static void machine_fini(struct machine *m)
+{
+	mem_fini(&m->memory);
+	free(m->text_decoded);
+	free(m->text_blocks);
+	m->text_decoded = NULL;
+	m->text_blocks = NULL;
+	profile_free(m);
+	free(m->pipeline);
+	m->pipeline = NULL;
+	predictor_free(m);
+	ooo_free(m);
+}
+
+/**
+ * Handler indices for the opcode and the funct fields. Unlisted entries are
+ * zero, i.e., OP_INVALID
+ */
+static const unsigned char opcode_ops[64] = {
+	[0x02] = OP_J,
+	[0x03] = OP_JAL,
+	[0x04] = OP_BEQ,
+	[0x05] = OP_BNE,
+	[0x08] = OP_ADDI,
+	[0x0a] = OP_SLTI,
+	[0x0c] = OP_ANDI,
+	[0x0d] = OP_ORI,
+	[0x23] = OP_LW,
+	[0x2b] = OP_SW,
+};
+
+static const unsigned char funct_ops[64] = {
+	[0x00] = OP_SLL,
+	[0x02] = OP_SRL,
+	[0x03] = OP_SRA,
+	[0x08] = OP_JR,
+	[0x20] = OP_ADD,
+	[0x22] = OP_SUB,
+	[0x24] = OP_AND,
+	[0x25] = OP_OR,
+	[0x27] = OP_NOR,
+	[0x2a] = OP_SLT,
+};
+
+/**********************************************************************
+ * decode_instruction(instr, addr, d)
+ *
+ * DESCRIPTION
+ *   Split @instr located at @addr into its fields and find out which
+ *   handler should execute it. The result is stored into @d.
+ */
+static void decode_instruction(unsigned int instr, unsigned int addr, struct decoded_instr *d)
+{
+	int opcode = instr >> 26;
+
+	d->instr = instr;
+	d->pc = addr;
+	d->rs = (instr >> 21) & 0x1f;
+	d->rt = (instr >> 16) & 0x1f;
+	d->rd = (instr >> 11) & 0x1f;
+	d->shamt = (instr >> 6) & 0x1f;
+	d->imm = instr & 0xffff;
+	d->simm = (unsigned int)(int)(short)(instr & 0xffff);
+	d->target = (instr & 0x3ffffff) << 2;
+
+	if(instr == 0xffffffff)
+		d->op = OP_HALT;
+	else if(opcode == 0)
+		d->op = funct_ops[instr & 0x3f];
+	else
+		d->op = opcode_ops[opcode];
+}
+
+/**********************************************************************
+ * fetch_instruction(addr)
+ *
+ * DESCRIPTION
+ *   Read the big-endian instruction word at @addr from @memory. Fetching
+ *   from a page never written is a memory fault, and the returned word is
+ *   an invalid instruction so that the program stops there.
+ */
+static inline unsigned int fetch_instruction(struct machine *m, unsigned int addr)
+{
+	if(mem_read_page(&m->memory, addr) == NULL)
+	{
+		m->memory.faulted = true;
+		m->memory.fault_addr = addr;
+		return 0xfc000000;
+	}
+	return mem_read_word(&m->memory, addr);
+}
+
+/**********************************************************************
+ * invalidate_text(addr, length)
+ *
+ * DESCRIPTION
+ *   Called after [@addr, @addr + @length) of @memory is overwritten. The
+ *   decoded records overlapping the range are decoded again, and the basic
+ *   blocks containing them are invalidated.
+ *
+ * RETURN
+ *   1 if the range overlaps the text region
+ *   0 otherwise
+ */
+static int invalidate_text(struct machine *m, unsigned int addr, unsigned int length)
+{
+	unsigned int from, to;
+
+	if(addr >= m->text_end || addr + length <= m->text_start)
+		return 0;
+
+	from = (addr < m->text_start) ? m->text_start : addr & ~(WORD_SIZE - 1);
+	to = (addr + length > m->text_end) ? m->text_end : addr + length;
+
+	for(unsigned int a = from; a < to; a += WORD_SIZE)
+	{
+		unsigned int index = (a - m->text_start) / WORD_SIZE;
+
+		//a를 포함하는 block은 a 앞쪽의 block end 다음부터 시작한다.
+		m->text_blocks[index].valid = false;
+		for(unsigned int i = index; i > 0 && !is_block_end[m->text_decoded[i - 1].op]; i--)
 		{
-			registers[rd] = registers[rt] >> shamt;
-			printf("srl // rt >> shamt = rd\t %x >> %x = %x\n", registers[rt], shamt, registers[rd]);
-			return 1;
+			m->text_blocks[i - 1].valid = false;
 		}
-		else if(funct == 0x03) //sra
-		{
-			if(registers[rt] >= 0x80000000)
-			{
-				registers[rd] = (registers[rt] >> shamt) + (0xffffffff << (32 - shamt));
-			}
-			else
-			{
-				registers[rd] = registers[rt] >> shamt;
-			}
-			printf("sra // rt >> shamt = rd\t %x >> %x = %x\n", registers[rt], shamt, registers[rd]);
-			return 1;
-		}
-		else if(funct == 0x2a) //slt
-		{
-
-			//registers[rs], registers[rt] 둘 다 음수일 때.
-			if((registers[rs] >= 0x80000000) && registers[rt] >= 0x80000000)
-				registers[rd] = (registers[rs] < registers[rt]) ? 1 : 0;
-			//registers[rs]만 음수 일 때.
-			else if(registers[rs] >= 0x80000000)
-				registers[rd] = 1;
-			//registers[rt]만 음수 일 때.
-			else if(registers[rt] >= 0x80000000)
-				registers[rd] = 0;
-			//둘 다 양수 일 때.
-			else
-				registers[rd] = (registers[rs] < registers[rt]) ? 1 : 0;
 
-			printf("rs -slt- rt = rd\t %x -slt- %x = %x\n", registers[rs], registers[rt], registers[rd]);
+		decode_instruction(fetch_instruction(m, a), a, &m->text_decoded[index]);
+	}
+	return 1;
+}
+
+/**********************************************************************
+ * decode_text(start, end)
+ *
+ * DESCRIPTION
+ *   (Re)build @text_decoded for the instructions in [@start, @end).
+ *
+ * RETURN
+ *   0 on success, any other value otherwise
+ */
+static int decode_text(struct machine *m, unsigned int start, unsigned int end)
+{
+	struct decoded_instr *decoded;
+	struct basic_block *blocks;
+	size_t nr_words = (end - start) / WORD_SIZE + 1;
+
+	decoded = realloc(m->text_decoded, sizeof(*decoded) * nr_words);
+	if(decoded == NULL)
+	{
+		fprintf(stderr, "Cannot allocate the decoded instructions\n");
+		return EXIT_FAILURE;
+	}
+	m->text_decoded = decoded;
+
+	blocks = realloc(m->text_blocks, sizeof(*blocks) * nr_words);
+	if(blocks == NULL)
+	{
+		fprintf(stderr, "Cannot allocate the basic blocks\n");
+		return EXIT_FAILURE;
+	}
+	memset(blocks, 0x00, sizeof(*blocks) * nr_words);
+	m->text_blocks = blocks;
+
+	m->text_start = start;
+	m->text_end = end;
+
+	for(unsigned int a = start; a < end; a += WORD_SIZE)
+	{
+		decode_instruction(fetch_instruction(m, a), a, &m->text_decoded[(a - start) / WORD_SIZE]);
+	}
+	return 0;
+}
+
+
+/**********************************************************************
+ * Instruction handlers
+ *
+ * DESCRIPTION
+ *   Each instruction is executed by its own handler, and the handlers are
+ *   reached through @handlers[] indexed by the handler index found by
+ *   @decode_instruction(). Refer to @process_instruction() for the list of
+ *   the supported instructions. The dispatch engine is selected at compile
+ *   time;
+ *
+ *   (default)               : Call through the @handlers[] function table
+ *   -DUSE_SWITCH_DISPATCH   : Jump over a switch statement on the index
+ *   -DUSE_THREADED_DISPATCH : Threaded interpreter using computed goto of
+ *                             GCC and Clang. Replaces the basic block engine
+ *                             of @run_fast(m)
+ *
+ *   The handlers of the branches and jumps compute the target from @pc, so
+ *   @pc should point to the next instruction (@d->pc + 4) when calling them.
+ *   The other handlers do not care about @pc.
+ *
+ * RETURN VALUE
+ *   1 if successfully processed the instruction.
+ *   2 if successfully processed the instruction which has overwritten the
+ *     text region.
+ *   0 if @d is 'halt' or unknown instructions
+ */
+#if defined(USE_THREADED_DISPATCH) && !defined(__GNUC__)
+#error "USE_THREADED_DISPATCH requires the computed goto of GCC or Clang"
+#endif
+
+static inline int op_add(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = (m->registers[rs] + m->registers[rt]);
+	return 1;
+}
+
+static inline int op_sub(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = m->registers[rs] - m->registers[rt];
+	return 1;
+}
+
+static inline int op_and(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = m->registers[rs] & m->registers[rt];
+	return 1;
+}
+
+static inline int op_or(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = m->registers[rs] | m->registers[rt];
+	return 1;
+}
+
+static inline int op_nor(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = ~(m->registers[rs] | m->registers[rt]);
+	return 1;
+}
+
+static inline int op_sll(struct machine *m, const struct decoded_instr *d)
+{
+	int rt = d->rt, rd = d->rd, shamt = d->shamt;
+
+	m->registers[rd] = m->registers[rt] << shamt;
+	return 1;
+}
+
+static inline int op_srl(struct machine *m, const struct decoded_instr *d)
+{
+	int rt = d->rt, rd = d->rd, shamt = d->shamt;
+
+	m->registers[rd] = m->registers[rt] >> shamt;
+	return 1;
+}
+
+static inline int op_sra(struct machine *m, const struct decoded_instr *d)
+{
+	int rt = d->rt, rd = d->rd, shamt = d->shamt;
+
+	m->registers[rd] = (unsigned int)((int)m->registers[rt] >> shamt);
+	return 1;
+}
+
+static inline int op_slt(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd;
+
+	m->registers[rd] = ((int)m->registers[rs] < (int)m->registers[rt]) ? 1 : 0;
+	return 1;
+}
+
+static inline int op_jr(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs;
+
+	m->pc = m->registers[rs];
+	return 1;
+}
+
+static inline int op_j(struct machine *m, const struct decoded_instr *d)
+{
+	m->pc = (m->pc & 0xf0000000) + d->target;
+	return 1;
+}
+
+static inline int op_jal(struct machine *m, const struct decoded_instr *d)
+{
+	m->registers[31] = m->pc;
+	m->pc = (m->pc & 0xf0000000) + d->target;
+	return 1;
+}
+
+static inline int op_addi(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	m->registers[rt] = m->registers[rs] + d->simm;
+	return 1;
+}
+
+static inline int op_andi(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	m->registers[rt] = m->registers[rs] & d->imm;
+	return 1;
+}
+
+static inline int op_ori(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	m->registers[rt] = m->registers[rs] | d->imm;
+	return 1;
+}
+
+static inline int op_lw(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+	unsigned int temp;
+
+	temp = m->registers[rs] + d->imm;
+	m->registers[rt] = mem_read_word(&m->memory, temp);
+	return 1;
+}
+
+static inline int op_sw(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+	unsigned int temp;
+
+	temp = m->registers[rs] + d->imm;
+	if(mem_write_word(&m->memory, temp, m->registers[rt]))
+		return 0;
+	if(invalidate_text(m, temp, WORD_SIZE))
+		return 2;
+	return 1;
+}
+
+static inline int op_slti(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	m->registers[rt] = (m->registers[rs] < d->imm) ? 1 : 0;
+	return 1;
+}
+
+static inline int op_beq(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	if(m->registers[rs] == m->registers[rt])
+		m->pc = m->pc + d->simm * WORD_SIZE;
+	return 1;
+}
+
+static inline int op_bne(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt;
+
+	if(m->registers[rs] != m->registers[rt])
+		m->pc = m->pc + d->simm * WORD_SIZE;
+	return 1;
+}
+
+static inline int op_halt(struct machine *m, const struct decoded_instr *d)
+{
+	(void)m;
+	(void)d;
+	return 0;
+}
+
+#ifndef USE_SWITCH_DISPATCH
+static int (* const handlers[NR_OPS])(struct machine *m, const struct decoded_instr *d) = {
+	[OP_INVALID] = op_halt,
+	[OP_ADD] = op_add,
+	[OP_ADDI] = op_addi,
+	[OP_SUB] = op_sub,
+	[OP_AND] = op_and,
+	[OP_ANDI] = op_andi,
+	[OP_OR] = op_or,
+	[OP_ORI] = op_ori,
+	[OP_NOR] = op_nor,
+	[OP_SLL] = op_sll,
+	[OP_SRL] = op_srl,
+	[OP_SRA] = op_sra,
+	[OP_LW] = op_lw,
+	[OP_SW] = op_sw,
+	[OP_SLT] = op_slt,
+	[OP_SLTI] = op_slti,
+	[OP_BEQ] = op_beq,
+	[OP_BNE] = op_bne,
+	[OP_JR] = op_jr,
+	[OP_J] = op_j,
+	[OP_JAL] = op_jal,
+	[OP_HALT] = op_halt,
+};
+#endif
+
+/**********************************************************************
+ * execute_instruction(d)
+ *
+ * DESCRIPTION
+ *   Execute the pre-decoded instruction @d with the selected engine.
+ *
+ * RETURN VALUE
+ *   1 if successfully processed the instruction.
+ *   0 if @d is 'halt' or unknown instructions
+ */
+static inline int execute_instruction(struct machine *m, const struct decoded_instr *d)
+{
+#ifdef USE_SWITCH_DISPATCH
+	switch(d->op)
+	{
+		case OP_ADD: return op_add(m, d);
+		case OP_ADDI: return op_addi(m, d);
+		case OP_SUB: return op_sub(m, d);
+		case OP_AND: return op_and(m, d);
+		case OP_ANDI: return op_andi(m, d);
+		case OP_OR: return op_or(m, d);
+		case OP_ORI: return op_ori(m, d);
+		case OP_NOR: return op_nor(m, d);
+		case OP_SLL: return op_sll(m, d);
+		case OP_SRL: return op_srl(m, d);
+		case OP_SRA: return op_sra(m, d);
+		case OP_LW: return op_lw(m, d);
+		case OP_SW: return op_sw(m, d);
+		case OP_SLT: return op_slt(m, d);
+		case OP_SLTI: return op_slti(m, d);
+		case OP_BEQ: return op_beq(m, d);
+		case OP_BNE: return op_bne(m, d);
+		case OP_JR: return op_jr(m, d);
+		case OP_J: return op_j(m, d);
+		case OP_JAL: return op_jal(m, d);
+		default: return op_halt(m, d);
+	}
+#else
+	return handlers[d->op](m, d);
+#endif
+}
+
+
+/**********************************************************************
+ * Tracing
+ *
+ * DESCRIPTION
+ *   @trace_level selects how much @run_program() reports, and can be
+ *   changed with the 'trace' command.
+ *
+ *   TRACE_OFF     : Print nothing
+ *   TRACE_SUMMARY : Print the number of retired instructions, the elapsed
+ *                   time, and MIPS (million instructions per second) at the
+ *                   end of the run
+ *   TRACE_FULL    : TRACE_SUMMARY + print every instruction as executed.
+ *                   The summary goes to stderr to keep the trace reproducible
+ *
+ *   Tracing every instruction makes the emulation bound by stdio. Thus the
+ *   messages are printed by @trace_instruction(m, d) from the separate
+ *   stepped loop, @run_stepped(m), and the loop used otherwise has no
+ *   tracing code in it at all.
+ */
+enum trace_levels {
+	TRACE_OFF = 0,
+	TRACE_SUMMARY,
+	TRACE_FULL,
+};
+
+static int trace_level = TRACE_FULL;
+
+/**********************************************************************
+ * trace_instruction(d)
+ *
+ * DESCRIPTION
+ *   Print what the instruction @d has done. Should be called right after
+ *   executing @d.
+ */
+static void trace_instruction(struct machine *m, const struct decoded_instr *d)
+{
+	int rs = d->rs, rt = d->rt, rd = d->rd, shamt = d->shamt;
+	unsigned int temp;
+
+	switch(d->op)
+	{
+		case OP_ADD:
+			printf("rs + rt = rd\t %x + %x = %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_SUB:
+			printf("rs - rt = rd\t %x - %x = %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_AND:
+			printf("rs & rt = rd\t %x & %x = %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_OR:
+			printf("rs | rt = rd\t %x | %x = %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_NOR:
+			printf("rs nor rt = rd\t %x nor %x =  %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_SLL:
+			printf("sll // rt << shamt = rd\t %x << %x =  %x\n", m->registers[rt], shamt, m->registers[rd]);
+			break;
+		case OP_SRL:
+			printf("srl // rt >> shamt = rd\t %x >> %x = %x\n", m->registers[rt], shamt, m->registers[rd]);
+			break;
+		case OP_SRA:
+			printf("sra // rt >> shamt = rd\t %x >> %x = %x\n", m->registers[rt], shamt, m->registers[rd]);
+			break;
+		case OP_SLT:
+			printf("rs -slt- rt = rd\t %x -slt- %x = %x\n", m->registers[rs], m->registers[rt], m->registers[rd]);
+			break;
+		case OP_JR:
+			printf("jr // rs pc\t %x %x\n", m->registers[rs], m->pc);
+			break;
+		case OP_J:
+			printf("j // instruction pc input : %x\n", m->pc);
+			break;
+		case OP_JAL:
+			printf("jal // ra : %x   pc : %x\n", m->registers[31], m->pc);
+			break;
+		case OP_ADDI:
+			printf("instant + rs = rt\t %d + %x = %x\n",
+					(d->imm >= 0x8000) ? 0x10000 - d->imm : d->imm, m->registers[rs], m->registers[rt]);
+			break;
+		case OP_ANDI:
+			printf("instant & rs = rt\t %x & %x = %x\n", d->imm, m->registers[rs], m->registers[rt]);
+			break;
+		case OP_ORI:
+			printf("instant ori rs = rt\t %x ori %x = %x\n", d->imm, m->registers[rs], m->registers[rt]);
+			break;
+		case OP_LW:
+			printf("load value = %x\n", m->registers[rt]);
+			break;
+		case OP_SW:
+			temp = m->registers[rs] + d->imm;
+			printf("instant : %x memory value: %x   store value : %x\n", d->imm, mem_read_byte(&m->memory, temp), m->registers[rt]);
+			break;
+		case OP_SLTI:
+			printf("slti// rs = %x   instant value : %x   rt = %x", m->registers[rs], d->imm, m->registers[rt]);
+			break;
+		case OP_BEQ:
+			if(m->registers[rs] == m->registers[rt])
+				printf("beq실행\nrs : %x   rt : %x   pc : %x\n", m->registers[rs], m->registers[rt], m->pc);
+			else
+				printf("beq 실행되지 않음\n");
+			break;
+		case OP_BNE:
+			if(m->registers[rs] != m->registers[rt])
+				printf("rs : %x   rt : %x   pc : %x\n", m->registers[rs], m->registers[rt], m->pc);
+			else
+				printf("bne 실행되지않음");
+			break;
+		default:
+			break;
+	}
+}
+
+/**********************************************************************
+ * Profiling
+ *
+ * DESCRIPTION
+ *   When profiling is turned on with 'profile on' command, @run_program()
+ *   counts how many times each instruction is executed as it runs. The
+ *   counts are kept per operation, per word of the text region, for
+ *   'beq'/'bne' whether the branch is taken, and for 'jal' per target.
+ *   'profile report' prints the hot spots sorted by the counts, and
+ *   'profile dump' writes all the counts in CSV or JSON.
+ *
+ *   Like the tracing, the counting is done from the stepped loop only, so
+ *   the program runs at the full speed when profiling is off.
+ */
+struct profile {
+	unsigned long long op_counts[NR_OPS];	/* Executions of each operation */
+	unsigned long long nr_outside;			/* Executions out of the text region */
+
+	/* Counts for each word in the text region [@start, @end) */
+	unsigned int start, end;
+	unsigned long long *counts;		/* Executions */
+	unsigned long long *taken;		/* Taken 'beq' and 'bne' */
+	unsigned long long *calls;		/* 'jal' to the word */
+};
+
+struct profile_entry {
+	unsigned int pc;
+	unsigned long long count;
+};
+
+static void profile_free(struct machine *m)
+{
+	if(m->profile == NULL)
+		return;
+	free(m->profile->counts);
+	free(m->profile->taken);
+	free(m->profile->calls);
+	free(m->profile);
+	m->profile = NULL;
+}
+
+/**********************************************************************
+ * profile_reset(m)
+ *
+ * DESCRIPTION
+ *   Clear the profile of @m and size the per-word counters for the current
+ *   text region.
+ *
+ * RETURN
+ *   0 on success, -1 if out of memory. Profiling is turned off on failure.
+ */
+static int profile_reset(struct machine *m)
+{
+	struct profile *p = m->profile;
+	size_t nr_words = (m->text_end - m->text_start) / WORD_SIZE;
+
+	free(p->counts);
+	free(p->taken);
+	free(p->calls);
+	memset(p, 0x00, sizeof(*p));
+	p->start = m->text_start;
+	p->end = m->text_end;
+
+	// 빈 text 영역이어도 calloc 이 NULL 을 돌려줄 수 있으니 1 word 는 잡아둔다
+	p->counts = calloc(nr_words + 1, sizeof(*p->counts));
+	p->taken = calloc(nr_words + 1, sizeof(*p->taken));
+	p->calls = calloc(nr_words + 1, sizeof(*p->calls));
+	if(p->counts == NULL || p->taken == NULL || p->calls == NULL)
+	{
+		fprintf(stderr, "Out of memory for the profile\n");
+		profile_free(m);
+		return -1;
+	}
+	return 0;
+}
+
+/**********************************************************************
+ * profile_instruction(m, d)
+ *
+ * DESCRIPTION
+ *   Count the execution of @d. Should be called right after executing @d.
+ */
+static inline void profile_instruction(struct machine *m, const struct decoded_instr *d)
+{
+	struct profile *p = m->profile;
+	unsigned int index = (d->pc - p->start) / WORD_SIZE;
+
+	p->op_counts[d->op]++;
+
+	//text 영역 밖에서 실행된 것은 operation 별로만 센다
+	if(d->pc - p->start >= p->end - p->start)
+	{
+		p->nr_outside++;
+		return;
+	}
+	p->counts[index]++;
+
+	if(d->op == OP_BEQ)
+	{
+		if(m->registers[d->rs] == m->registers[d->rt])
+			p->taken[index]++;
+	}
+	else if(d->op == OP_BNE)
+	{
+		if(m->registers[d->rs] != m->registers[d->rt])
+			p->taken[index]++;
+	}
+	else if(d->op == OP_JAL)
+	{
+		if(m->pc - p->start < p->end - p->start)
+			p->calls[(m->pc - p->start) / WORD_SIZE]++;
+	}
+}
+
+static int compare_profile_entries(const void *a, const void *b)
+{
+	const struct profile_entry *x = a, *y = b;
+
+	if(x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+/**********************************************************************
+ * collect_profile(p, counts, entries)
+ *
+ * DESCRIPTION
+ *   Gather the words whose @counts are not zero into @entries, sorted by
+ *   the counts in the descending order.
+ *
+ * RETURN
+ *   The number of entries gathered
+ */
+static size_t collect_profile(const struct profile *p, const unsigned long long *counts, struct profile_entry *entries)
+{
+	size_t nr_entries = 0;
+
+	for(size_t i = 0; i < (p->end - p->start) / WORD_SIZE; i++)
+	{
+		if(counts[i] == 0)
+			continue;
+		entries[nr_entries].pc = p->start + i * WORD_SIZE;
+		entries[nr_entries].count = counts[i];
+		nr_entries++;
+	}
+	qsort(entries, nr_entries, sizeof(*entries), compare_profile_entries);
+	return nr_entries;
+}
+
+static unsigned long long profile_total(const struct profile *p)
+{
+	unsigned long long total = 0;
+
+	for(int i = 0; i < NR_OPS; i++)
+		total += p->op_counts[i];
+	return total;
+}
+
+/* Operation at @pc in the text region as it is decoded now */
+static inline int profile_op(struct machine *m, unsigned int pc)
+{
+	return m->text_decoded[(pc - m->text_start) / WORD_SIZE].op;
+}
+
+static inline const char *profile_op_name(struct machine *m, unsigned int pc)
+{
+	return op_names[profile_op(m, pc)];
+}
+
+/**********************************************************************
+ * profile_report(m, nr_lines)
+ *
+ * DESCRIPTION
+ *   Print the instruction mix and up to @nr_lines hottest words, branches,
+ *   and call targets of the last run.
+ */
+static void profile_report(struct machine *m, size_t nr_lines)
+{
+	struct profile *p = m->profile;
+	struct profile_entry *entries;
+	unsigned long long total;
+	size_t nr_entries;
+
+	if(p == NULL || p->counts == NULL)
+	{
+		printf("No profile. Run the program after 'profile on'\n");
+		return;
+	}
+	if(p->start != m->text_start || p->end != m->text_end)
+	{
+		printf("The profile is stale. Run the program again\n");
+		return;
+	}
+	entries = malloc(((p->end - p->start) / WORD_SIZE + 1) * sizeof(*entries));
+	if(entries == NULL)
+		return;
+	total = profile_total(p);
+
+	printf("Instruction mix (%llu instructions)\n", total);
+	for(int i = 0; i < NR_OPS; i++)
+	{
+		if(p->op_counts[i])
+			printf("  %-8s %14llu  %6.2f%%\n", op_names[i], p->op_counts[i], 100.0 * p->op_counts[i] / total);
+	}
+	if(p->nr_outside)
+		printf("  (%llu executed out of the text region)\n", p->nr_outside);
+
+	printf("Hot spots\n");
+	nr_entries = collect_profile(p, p->counts, entries);
+	for(size_t i = 0; i < nr_entries && i < nr_lines; i++)
+	{
+		printf("  0x%08x  %-8s %14llu  %6.2f%%\n", entries[i].pc, profile_op_name(m, entries[i].pc),
+				entries[i].count, 100.0 * entries[i].count / total);
+	}
+
+	//branch 는 실행 횟수 순으로, taken 과 not taken 을 같이 보여준다
+	printf("Branches\n");
+	for(size_t i = 0, nr_printed = 0; i < nr_entries && nr_printed < nr_lines; i++)
+	{
+		unsigned int index = (entries[i].pc - p->start) / WORD_SIZE;
+		int op = profile_op(m, entries[i].pc);
+
+		if(op != OP_BEQ && op != OP_BNE)
+			continue;
+		printf("  0x%08x  %-8s taken %llu  not taken %llu  (%.2f%% taken)\n", entries[i].pc, op_names[op],
+				p->taken[index], entries[i].count - p->taken[index], 100.0 * p->taken[index] / entries[i].count);
+		nr_printed++;
+	}
+
+	printf("Calls\n");
+	nr_entries = collect_profile(p, p->calls, entries);
+	for(size_t i = 0; i < nr_entries && i < nr_lines; i++)
+		printf("  0x%08x  %14llu\n", entries[i].pc, entries[i].count);
+
+	free(entries);
+}
+
+/**********************************************************************
+ * profile_dump(m, filename)
+ *
+ * DESCRIPTION
+ *   Write the profile of the last run into @filename. The profile is
+ *   written in JSON if @filename ends with ".json", and in CSV otherwise.
+ *   The CSV has a row for each operation and for each executed word;
+ *
+ *     kind,pc,op,count,taken,calls
+ *     op,,addi,1234,,
+ *     pc,0x00001008,bne,1000,999,0
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int profile_dump(struct machine *m, char * const filename)
+{
+	struct profile *p = m->profile;
+	const char *suffix = strrchr(filename, '.');
+	bool json = suffix && strmatch((char *)suffix, ".json");
+	bool first = true;
+	FILE *fp;
+
+	if(p == NULL || p->counts == NULL || p->start != m->text_start || p->end != m->text_end)
+	{
+		printf("No profile to dump. Run the program after 'profile on'\n");
+		return -1;
+	}
+	fp = fopen(filename, "w");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if(json)
+		fprintf(fp, "{\n  \"instructions\": %llu,\n  \"outside_text\": %llu,\n  \"ops\": {",
+				profile_total(p), p->nr_outside);
+	else
+		fprintf(fp, "kind,pc,op,count,taken,calls\n");
+
+	for(int i = 0; i < NR_OPS; i++)
+	{
+		if(p->op_counts[i] == 0)
+			continue;
+		if(json)
+			fprintf(fp, "%s\n    \"%s\": %llu", first ? "" : ",", op_names[i], p->op_counts[i]);
+		else
+			fprintf(fp, "op,,%s,%llu,,\n", op_names[i], p->op_counts[i]);
+		first = false;
+	}
+
+	if(json)
+		fprintf(fp, "\n  },\n  \"pcs\": [");
+	first = true;
+	for(size_t i = 0; i < (p->end - p->start) / WORD_SIZE; i++)
+	{
+		unsigned int pc = p->start + i * WORD_SIZE;
+
+		if(p->counts[i] == 0 && p->calls[i] == 0)
+			continue;
+		if(json)
+			fprintf(fp, "%s\n    {\"pc\": %u, \"op\": \"%s\", \"count\": %llu, \"taken\": %llu, \"calls\": %llu}",
+					first ? "" : ",", pc, profile_op_name(m, pc), p->counts[i], p->taken[i], p->calls[i]);
+		else
+			fprintf(fp, "pc,0x%08x,%s,%llu,%llu,%llu\n",
+					pc, profile_op_name(m, pc), p->counts[i], p->taken[i], p->calls[i]);
+		first = false;
+	}
+	if(json)
+		fprintf(fp, "\n  ]\n}\n");
+
+	fclose(fp);
+	return 0;
+}
+
+
+/**********************************************************************
+ * Cache model
+ *
+ * DESCRIPTION
+ *   Built with -DUSE_CACHE_MODEL and linked with pa3.c built with
+ *   -DCACHE_SIM_LIBRARY, the emulator can run programs through the cache
+ *   model of pa3.c to estimate how long they take;
+ *
+ *     gcc -c -DCACHE_SIM_LIBRARY pa3.c
+ *     gcc -DUSE_CACHE_MODEL pa2.c pa3.o -o pa2
+ *
+ *   'cache on' sets the model up and selects @cache_model;
+ *
+ *   CACHE_MODEL_OFF  : Run without the model
+ *   CACHE_MODEL_DATA : Every 'lw' and 'sw' goes through the model
+ *   CACHE_MODEL_ALL  : CACHE_MODEL_DATA + every instruction is fetched
+ *                      through the model (the L1 instruction cache of the
+ *                      model if it has one)
+ *
+ *   The programs still read and write @memory of the machine; the model
+ *   only tells how long the accesses take. Every instruction takes a cycle
+ *   plus the cycles its accesses take in the model. The model is emptied
+ *   when a program starts to run, and is kept over 'resume'. Like the
+ *   profiling, the accesses are fed from the stepped loop only.
+ */
+enum cache_model_modes {
+	CACHE_MODEL_OFF = 0,
+	CACHE_MODEL_DATA,
+	CACHE_MODEL_ALL,
+};
+
+static int cache_model = CACHE_MODEL_OFF;
+
+#ifdef USE_CACHE_MODEL
+/* Instructions retired on the model since it is reset */
+static unsigned long long cache_model_instructions = 0;
+
+/* From pa3.c */
+int init_cache_model(int argc, const char *argv[]);
+int reset_cache_model(void);
+void fini_cache_model(void);
+unsigned long long cache_model_cycles(void);
+void report_cache_model(void);
+void set_access_pc(unsigned int pc);
+int load_word(unsigned int addr);
+int store_word(unsigned int addr, unsigned int data);
+int fetch_word(unsigned int addr);
+
+/**********************************************************************
+ * model_instruction(m, d)
+ *
+ * DESCRIPTION
+ *   Feed the accesses of @d to the model. Should be called before
+ *   executing @d as @d may overwrite the registers it accesses with.
+ *
+ * RETURN
+ *   The cycles the accesses take beyond a cycle for each, which IF and MEM
+ *   take anyway. 0 if they take less
+ */
+static inline unsigned int model_instruction(struct machine *m, const struct decoded_instr *d)
+{
+	unsigned long long start = cache_model_cycles();
+	unsigned long long cycles;
+	unsigned int nr_accesses = 0;
+
+	if(cache_model == CACHE_MODEL_ALL)
+	{
+		fetch_word(d->pc);
+		nr_accesses++;
+	}
+
+	//address는 op_lw, op_sw와 같게 계산한다
+	if(d->op == OP_LW)
+	{
+		set_access_pc(d->pc);
+		load_word(m->registers[d->rs] + d->imm);
+		nr_accesses++;
+	}
+	else if(d->op == OP_SW)
+	{
+		store_word(m->registers[d->rs] + d->imm, m->registers[d->rt]);
+		nr_accesses++;
+	}
+	//hit latency가 0인 level이 있으면 한 cycle보다 적게 걸릴 수 있다
+	cycles = cache_model_cycles() - start;
+	return cycles > nr_accesses ? cycles - nr_accesses : 0;
+}
+
+/**********************************************************************
+ * setup_cache_model(argc, argv)
+ *
+ * DESCRIPTION
+ *   Handle 'cache on [-f] [options of pa3] [words per block] [number of
+ *   blocks] [number of ways]'. The instructions are fetched through the
+ *   model as well with '-f'.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int setup_cache_model(int argc, char *argv[])
+{
+	const char *options[MAX_NR_TOKENS] = { "cache" };
+	int nr_options = 1;
+	int mode = CACHE_MODEL_DATA;
+
+	//argv[0], argv[1]은 "cache", "on". -f 는 여기서 처리하고 나머지는 pa3 에 넘긴다
+	for(int i = 2; i < argc; i++)
+	{
+		if(strmatch(argv[i], "-f"))
+			mode = CACHE_MODEL_ALL;
+		else
+			options[nr_options++] = argv[i];
+	}
+
+	if(init_cache_model(nr_options, options) < 0)
+	{
+		fprintf(stderr, "Unable to set up the cache model\n");
+		cache_model = CACHE_MODEL_OFF;
+		return -1;
+	}
+	cache_model = mode;
+	cache_model_instructions = 0;
+	return 0;
+}
+
+static void report_cycles(void)
+{
+	unsigned long long cycles = cache_model_instructions + cache_model_cycles();
+
+	printf("%llu cycles for %llu instructions (CPI %.2f)\n", cycles, cache_model_instructions,
+			cache_model_instructions ? (double)cycles / cache_model_instructions : 0.0);
+	report_cache_model();
+}
+#endif
+
+
+/**********************************************************************
+ * Pipeline model
+ *
+ * DESCRIPTION
+ *   'pipeline on' times the run on the classic 5-stage pipeline (IF, ID,
+ *   EX, MEM, and WB) while the instructions are still executed one at a
+ *   time. For each instruction, the model finds the cycle at which it can
+ *   be in ID given the instructions before it, and charges the cycles it
+ *   waits there to their cause;
+ *
+ *   STALL_LOAD_USE : An operand is loaded by a 'lw' not far enough ahead
+ *   STALL_DATA     : An operand is computed by an instruction not far
+ *                    enough ahead
+ *   STALL_BRANCH   : A taken 'beq' or 'bne' flushes the instructions
+ *                    fetched after it
+ *   STALL_JUMP     : 'j', 'jal', or 'jr' flushes the instructions fetched
+ *                    after it
+ *   STALL_MEMORY   : The cache model takes more than a cycle for the
+ *                    accesses of the instruction (see 'Cache model'). The
+ *                    whole pipeline is frozen meanwhile
+ *
+ *   With the forwarding paths (the default), a result is passed to the
+ *   following instructions right after the stage computing it, i.e., EX or
+ *   MEM for 'lw'. Otherwise, the following instructions read it from the
+ *   register file in ID, which is written in the first half of WB.
+ *
+ *   The branches are predicted not taken unless a branch predictor is on
+ *   (see 'Branch prediction'). 'j' and 'jal' are resolved in ID, and 'beq',
+ *   'bne', and 'jr' in @resolve_stage; ID needs their operands one stage
+ *   earlier than EX does, but takes one cycle less to redirect the fetch.
+ */
+enum pipeline_stages {
+	STAGE_IF = 0,
+	STAGE_ID,
+	STAGE_EX,
+	STAGE_MEM,
+	STAGE_WB,
+};
+
+enum stall_causes {
+	STALL_LOAD_USE = 0,
+	STALL_DATA,
+	STALL_BRANCH,
+	STALL_JUMP,
+	STALL_MEMORY,
+	NR_STALL_CAUSES,
+};
+
+static const char * const stall_names[NR_STALL_CAUSES] = {
+	"load-use", "data", "branch", "jump", "memory",
+};
+
+struct pipeline {
+	bool forwarding;
+	int resolve_stage;		/* Where 'beq', 'bne', and 'jr' are resolved. STAGE_ID or STAGE_EX */
+
+	unsigned long long ready[32];	/* First cycle a stage can use each register in */
+	bool loaded[32];				/* Whether each register is written by 'lw' */
+	unsigned long long next_id;		/* First cycle the next instruction can be in ID */
+	unsigned long long last_wb;		/* When the last instruction leaves WB */
+
+	unsigned long long nr_instructions;
+	unsigned long long nr_flushes;
+	unsigned long long stalls[NR_STALL_CAUSES];
+};
+
+/* Operands of an instruction and the stages that need them */
+struct operand {
+	int reg;
+	int stage;
+};
+
+/**********************************************************************
+ * instruction_registers(d, sources, dest)
+ *
+ * DESCRIPTION
+ *   Find the registers @d reads into @sources, each with the stage that
+ *   needs it when the results are forwarded, and the register @d writes
+ *   into @dest (0 if none). $zero is never listed as a source.
+ *
+ * RETURN
+ *   The number of the sources
+ */
+static int instruction_registers(const struct decoded_instr *d, struct operand sources[2], int *dest)
+{
+	int nr_sources = 0;
+
+	*dest = 0;
+	switch(d->op)
+	{
+		case OP_ADD: case OP_SUB: case OP_AND: case OP_OR: case OP_NOR: case OP_SLT:
+			sources[nr_sources++] = (struct operand){ d->rs, STAGE_EX };
+			sources[nr_sources++] = (struct operand){ d->rt, STAGE_EX };
+			*dest = d->rd;
+			break;
+		case OP_SLL: case OP_SRL: case OP_SRA:
+			sources[nr_sources++] = (struct operand){ d->rt, STAGE_EX };
+			*dest = d->rd;
+			break;
+		case OP_ADDI: case OP_ANDI: case OP_ORI: case OP_SLTI: case OP_LW:
+			sources[nr_sources++] = (struct operand){ d->rs, STAGE_EX };
+			*dest = d->rt;
+			break;
+		case OP_SW:
+			//저장할 값은 MEM 에서야 필요하다
+			sources[nr_sources++] = (struct operand){ d->rs, STAGE_EX };
+			sources[nr_sources++] = (struct operand){ d->rt, STAGE_MEM };
+			break;
+		case OP_BEQ: case OP_BNE:
+			sources[nr_sources++] = (struct operand){ d->rs, STAGE_EX };
+			sources[nr_sources++] = (struct operand){ d->rt, STAGE_EX };
+			break;
+		case OP_JR:
+			sources[nr_sources++] = (struct operand){ d->rs, STAGE_EX };
+			break;
+		case OP_JAL:
+			*dest = 31;
+			break;
+		default:
+			break;
+	}
+
+	//$zero 는 항상 0 이라 기다릴 일이 없다
+	for(int i = 0; i < nr_sources; i++)
+	{
+		if(sources[i].reg == 0)
+			sources[i--] = sources[--nr_sources];
+	}
+	return nr_sources;
+}
+
+/* Cycles flushed after @d with the branches predicted not taken */
+static inline unsigned int not_taken_penalty(struct machine *m, const struct decoded_instr *d, int resolve_stage)
+{
+	if(d->op == OP_J || d->op == OP_JAL)
+		return STAGE_ID - STAGE_IF;
+	if(d->op == OP_JR || ((d->op == OP_BEQ || d->op == OP_BNE) && m->pc != d->pc + WORD_SIZE))
+		return resolve_stage - STAGE_IF;
+	return 0;
+}
+
+static void pipeline_reset(struct pipeline *p)
+{
+	bool forwarding = p->forwarding;
+	int resolve_stage = p->resolve_stage;
+
+	memset(p, 0x00, sizeof(*p));
+	p->forwarding = forwarding;
+	p->resolve_stage = resolve_stage;
+	//첫 instruction 은 1 cycle 에 IF, 2 cycle 에 ID
+	p->next_id = 2;
+}
+
+/**********************************************************************
+ * pipeline_instruction(m, d, memory_stall, flush)
+ *
+ * DESCRIPTION
+ *   Time @d on the pipeline of @m, where the accesses of @d take
+ *   @memory_stall cycles more than a cycle, and the instructions fetched
+ *   wrongly after @d are flushed for @flush cycles. Should be called right
+ *   after executing @d.
+ */
+static void pipeline_instruction(struct machine *m, const struct decoded_instr *d,
+		unsigned int memory_stall, unsigned int flush)
+{
+	struct pipeline *p = m->pipeline;
+	struct operand sources[2];
+	int dest, nr_sources = instruction_registers(d, sources, &dest);
+	unsigned long long id = p->next_id;
+	int cause = STALL_DATA;
+
+	//operand 가 준비될 때까지 ID 에서 기다린다
+	for(int i = 0; i < nr_sources; i++)
+	{
+		int stage = sources[i].stage;
+		unsigned int lead;
+		unsigned long long earliest;
+
+		if(!p->forwarding)
+			stage = STAGE_ID;
+		else if(p->resolve_stage == STAGE_ID && (d->op == OP_BEQ || d->op == OP_BNE || d->op == OP_JR))
+			stage = STAGE_ID;
+		lead = stage - STAGE_ID;
+		earliest = p->ready[sources[i].reg] > lead ? p->ready[sources[i].reg] - lead : 0;
+		if(earliest > id)
+		{
+			id = earliest;
+			cause = p->loaded[sources[i].reg] ? STALL_LOAD_USE : STALL_DATA;
+		}
+	}
+	p->stalls[cause] += id - p->next_id;
+	p->stalls[STALL_MEMORY] += memory_stall;
+	p->nr_instructions++;
+	p->next_id = id + 1 + memory_stall;
+	p->last_wb = id + (STAGE_WB - STAGE_ID) + memory_stall;
+
+	if(dest)
+	{
+		if(!p->forwarding)
+			p->ready[dest] = p->last_wb;
+		else if(d->op == OP_LW)
+			p->ready[dest] = id + (STAGE_MEM - STAGE_ID) + memory_stall + 1;
+		else
+			p->ready[dest] = id + (STAGE_EX - STAGE_ID) + memory_stall + 1;
+		p->loaded[dest] = d->op == OP_LW;
+	}
+
+	//잘못 fetch 한 것을 버리고 resolve 된 다음 cycle 부터 다시 fetch 한다
+	if(flush)
+	{
+		p->nr_flushes++;
+		p->stalls[d->op == OP_BEQ || d->op == OP_BNE ? STALL_BRANCH : STALL_JUMP] += flush;
+		p->next_id += flush;
+	}
+}
+
+/**********************************************************************
+ * pipeline_report(m)
+ *
+ * DESCRIPTION
+ *   Print the cycles, CPI, and the stalls by cause of the last run.
+ */
+static void pipeline_report(struct machine *m)
+{
+	struct pipeline *p = m->pipeline;
+	unsigned long long nr_stalls = 0;
+
+	if(p == NULL || p->nr_instructions == 0)
+	{
+		printf("No pipeline timing. Run the program after 'pipeline on'\n");
+		return;
+	}
+	for(int i = 0; i < NR_STALL_CAUSES; i++)
+		nr_stalls += p->stalls[i];
+
+	printf("Pipeline (%s forwarding, branches resolved in %s)\n",
+			p->forwarding ? "with" : "without", p->resolve_stage == STAGE_ID ? "ID" : "EX");
+	printf("  %llu cycles for %llu instructions (CPI %.2f)\n", p->last_wb, p->nr_instructions,
+			(double)p->last_wb / p->nr_instructions);
+	printf("  %llu stall cycles, %llu flushes\n", nr_stalls, p->nr_flushes);
+	for(int i = 0; i < NR_STALL_CAUSES; i++)
+	{
+		if(p->stalls[i])
+			printf("  %-8s %14llu  %6.2f%%  (%.3f per instruction)\n", stall_names[i], p->stalls[i],
+					100.0 * p->stalls[i] / nr_stalls, (double)p->stalls[i] / p->nr_instructions);
+	}
+}
+
+/**********************************************************************
+ * setup_pipeline(m, argc, argv)
+ *
+ * DESCRIPTION
+ *   Handle 'pipeline on { -n } { -b id|ex }'. The results are not forwarded
+ *   with '-n', and '-b' selects where the branches are resolved.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int setup_pipeline(struct machine *m, int argc, char *argv[])
+{
+	bool forwarding = true;
+	int resolve_stage = STAGE_ID;
+
+	for(int i = 2; i < argc; i++)
+	{
+		if(strmatch(argv[i], "-n"))
+			forwarding = false;
+		else if(strmatch(argv[i], "-b") && i + 1 < argc && strmatch(argv[i + 1], "id"))
+		{
+			resolve_stage = STAGE_ID;
+			i++;
+		}
+		else if(strmatch(argv[i], "-b") && i + 1 < argc && strmatch(argv[i + 1], "ex"))
+		{
+			resolve_stage = STAGE_EX;
+			i++;
+		}
+		else
+		{
+			printf("Unknown pipeline option %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	if(m->pipeline == NULL)
+		m->pipeline = calloc(1, sizeof(*m->pipeline));
+	if(m->pipeline == NULL)
+		return -1;
+	m->pipeline->forwarding = forwarding;
+	m->pipeline->resolve_stage = resolve_stage;
+	pipeline_reset(m->pipeline);
+	return 0;
+}
+
+
+/**********************************************************************
+ * Branch prediction
+ *
+ * DESCRIPTION
+ *   'predict on' predicts every 'beq', 'bne', 'j', 'jal', and 'jr' when it
+ *   is fetched, and checks the prediction once it is executed. The
+ *   direction of 'beq' and 'bne' is predicted by one of
+ *
+ *   taken, not-taken : Always the same direction
+ *   bimodal          : A table of 2-bit counters indexed by the PC
+ *   gshare           : A table of 2-bit counters indexed by the PC
+ *                      XORed with the directions of the latest branches
+ *   tournament       : Both bimodal and gshare, with a table of 2-bit
+ *                      counters indexed by the PC choosing which to follow
+ *
+ *   and the targets come from a direct-mapped branch target buffer (BTB),
+ *   which remembers the last target of each taken branch and jump, except
+ *   for 'jr $ra' which pops the return address stack (RAS) pushed by 'jal'.
+ *
+ *   A wrong direction or a wrong 'jr' target is found where the branches
+ *   are resolved (see 'Pipeline model'; EX when the pipeline model is off),
+ *   and flushes the instructions fetched meanwhile. A taken branch or a
+ *   jump of which the target is not in the BTB costs a cycle, as its target
+ *   is known in ID. The flushed cycles are accounted to each branch, and
+ *   replace the penalties of the pipeline model when both are on.
+ */
+#define MAX_RAS_DEPTH	64
+
+enum predictor_kinds {
+	PREDICT_TAKEN = 0,
+	PREDICT_NOT_TAKEN,
+	PREDICT_BIMODAL,
+	PREDICT_GSHARE,
+	PREDICT_TOURNAMENT,
+	NR_PREDICTORS,
+};
+
+static const char * const predictor_names[NR_PREDICTORS] = {
+	"taken", "not-taken", "bimodal", "gshare", "tournament",
+};
+
+struct predictor {
+	int kind;					/* One of PREDICT_* */
+	int table_bits;				/* log2 of the entries of each table */
+	unsigned char *bimodal;		/* 2-bit counters. Taken if >= 2 */
+	unsigned char *gshare;
+	unsigned char *chooser;		/* Follow gshare if >= 2 */
+	unsigned int history;		/* Directions of the latest branches. 1 for taken */
+
+	unsigned int nr_btb_entries;	/* 0 if no BTB. Power of two */
+	unsigned int *btb_pcs;			/* PC of the branch in each entry. 1 if empty */
+	unsigned int *btb_targets;
+
+	int ras_depth;				/* 0 if no RAS */
+	unsigned int ras[MAX_RAS_DEPTH];
+	int ras_top;				/* Next slot to push */
+	int ras_count;
+
+	/* Prediction for the instruction being executed */
+	bool predicted_taken;
+	bool target_known;
+	unsigned int predicted_target;
+
+	unsigned long long nr_branches;		/* 'beq' and 'bne' */
+	unsigned long long nr_taken;
+	unsigned long long nr_wrong_directions;
+	unsigned long long nr_jumps;		/* 'j' and 'jal' */
+	unsigned long long nr_returns;		/* 'jr $ra' */
+	unsigned long long nr_wrong_returns;
+	unsigned long long nr_indirects;	/* 'jr' to the other registers */
+	unsigned long long nr_wrong_indirects;
+	unsigned long long nr_btb_lookups;
+	unsigned long long nr_btb_hits;
+	unsigned long long penalty;			/* Cycles flushed */
+
+	/* Counts for each word in the text region [@start, @end) */
+	unsigned int start, end;
+	unsigned long long *executed;
+	unsigned long long *mispredicted;
+	unsigned long long *penalties;
+};
+
+static void predictor_free(struct machine *m)
+{
+	struct predictor *p = m->predictor;
+
+	if(p == NULL)
+		return;
+	free(p->bimodal);
+	free(p->gshare);
+	free(p->chooser);
+	free(p->btb_pcs);
+	free(p->btb_targets);
+	free(p->executed);
+	free(p->mispredicted);
+	free(p->penalties);
+	free(p);
+	m->predictor = NULL;
+}
+
+/**********************************************************************
+ * predictor_reset(m)
+ *
+ * DESCRIPTION
+ *   Forget what the predictor of @m has learned and counted, and size the
+ *   per-word counters for the current text region.
+ *
+ * RETURN
+ *   0 on success, -1 if out of memory. The predictor is turned off on
+ *   failure.
+ */
+static int predictor_reset(struct machine *m)
+{
+	struct predictor *p = m->predictor;
+	size_t nr_entries = (size_t)1 << p->table_bits;
+	size_t nr_words = (m->text_end - m->text_start) / WORD_SIZE;
+
+	free(p->executed);
+	free(p->mispredicted);
+	free(p->penalties);
+	p->executed = calloc(nr_words + 1, sizeof(*p->executed));
+	p->mispredicted = calloc(nr_words + 1, sizeof(*p->mispredicted));
+	p->penalties = calloc(nr_words + 1, sizeof(*p->penalties));
+	if(p->bimodal == NULL)
+	{
+		p->bimodal = malloc(nr_entries);
+		p->gshare = malloc(nr_entries);
+		p->chooser = malloc(nr_entries);
+	}
+	if(p->btb_pcs == NULL && p->nr_btb_entries)
+	{
+		p->btb_pcs = malloc(sizeof(*p->btb_pcs) * p->nr_btb_entries);
+		p->btb_targets = malloc(sizeof(*p->btb_targets) * p->nr_btb_entries);
+	}
+	if(!p->executed || !p->mispredicted || !p->penalties || !p->bimodal || !p->gshare || !p->chooser ||
+			(p->nr_btb_entries && (!p->btb_pcs || !p->btb_targets)))
+	{
+		fprintf(stderr, "Out of memory for the branch predictor\n");
+		predictor_free(m);
+		return -1;
+	}
+
+	//약하게 not taken, 선택은 약하게 bimodal 쪽에서 시작한다
+	memset(p->bimodal, 1, nr_entries);
+	memset(p->gshare, 1, nr_entries);
+	memset(p->chooser, 1, nr_entries);
+	for(unsigned int i = 0; i < p->nr_btb_entries; i++)
+		p->btb_pcs[i] = 1;
+	p->history = 0;
+	p->ras_top = p->ras_count = 0;
+	p->start = m->text_start;
+	p->end = m->text_end;
+
+	p->nr_branches = p->nr_taken = p->nr_wrong_directions = 0;
+	p->nr_jumps = p->nr_returns = p->nr_wrong_returns = 0;
+	p->nr_indirects = p->nr_wrong_indirects = 0;
+	p->nr_btb_lookups = p->nr_btb_hits = 0;
+	p->penalty = 0;
+	return 0;
+}
+
+static inline void update_counter(unsigned char *counter, bool up)
+{
+	if(up && *counter < 3)
+		(*counter)++;
+	else if(!up && *counter > 0)
+		(*counter)--;
+}
+
+static inline unsigned int bimodal_index(const struct predictor *p, unsigned int pc)
+{
+	return (pc / WORD_SIZE) & ((1u << p->table_bits) - 1);
+}
+
+static inline unsigned int gshare_index(const struct predictor *p, unsigned int pc)
+{
+	return ((pc / WORD_SIZE) ^ p->history) & ((1u << p->table_bits) - 1);
+}
+
+/* Direction of the branch at @pc */
+static bool predict_direction(const struct predictor *p, unsigned int pc)
+{
+	switch(p->kind)
+	{
+		case PREDICT_TAKEN:
+			return true;
+		case PREDICT_NOT_TAKEN:
+			return false;
+		case PREDICT_BIMODAL:
+			return p->bimodal[bimodal_index(p, pc)] >= 2;
+		case PREDICT_GSHARE:
+			return p->gshare[gshare_index(p, pc)] >= 2;
+		default:
+			if(p->chooser[bimodal_index(p, pc)] >= 2)
+				return p->gshare[gshare_index(p, pc)] >= 2;
+			return p->bimodal[bimodal_index(p, pc)] >= 2;
+	}
+}
+
+static void train_direction(struct predictor *p, unsigned int pc, bool taken)
+{
+	unsigned char *bimodal = &p->bimodal[bimodal_index(p, pc)];
+	unsigned char *gshare = &p->gshare[gshare_index(p, pc)];
+
+	//둘의 예측이 다를 때만 맞힌 쪽으로 chooser 를 옮긴다
+	if((*bimodal >= 2) != (*gshare >= 2))
+		update_counter(&p->chooser[bimodal_index(p, pc)], (*gshare >= 2) == taken);
+	update_counter(bimodal, taken);
+	update_counter(gshare, taken);
+	p->history = ((p->history << 1) | taken) & ((1u << p->table_bits) - 1);
+}
+
+static inline bool lookup_btb(struct predictor *p, unsigned int pc, unsigned int *target)
+{
+	unsigned int i = (pc / WORD_SIZE) & (p->nr_btb_entries - 1);
+
+	if(p->nr_btb_entries == 0)
+		return false;
+	p->nr_btb_lookups++;
+	if(p->btb_pcs[i] != pc)
+		return false;
+	p->nr_btb_hits++;
+	*target = p->btb_targets[i];
+	return true;
+}
+
+static inline void update_btb(struct predictor *p, unsigned int pc, unsigned int target)
+{
+	unsigned int i = (pc / WORD_SIZE) & (p->nr_btb_entries - 1);
+
+	if(p->nr_btb_entries == 0)
+		return;
+	p->btb_pcs[i] = pc;
+	p->btb_targets[i] = target;
+}
+
+/**********************************************************************
+ * predict_fetch(m, d)
+ *
+ * DESCRIPTION
+ *   Predict where to fetch after @d. Should be called when @d is fetched,
+ *   i.e., before executing @d.
+ */
+static void predict_fetch(struct machine *m, const struct decoded_instr *d)
+{
+	struct predictor *p = m->predictor;
+
+	p->predicted_taken = false;
+	p->target_known = false;
+	switch(d->op)
+	{
+		case OP_BEQ: case OP_BNE:
+			p->predicted_taken = predict_direction(p, d->pc);
+			if(p->predicted_taken)
+				p->target_known = lookup_btb(p, d->pc, &p->predicted_target);
+			break;
+		case OP_JAL:
+			//return address 는 jal 을 fetch 할 때 쌓는다
+			if(p->ras_depth)
+			{
+				p->ras[p->ras_top] = d->pc + WORD_SIZE;
+				p->ras_top = (p->ras_top + 1) % p->ras_depth;
+				if(p->ras_count < p->ras_depth)
+					p->ras_count++;
+			}
+			/* fall through */
+		case OP_J:
+			p->predicted_taken = true;
+			p->target_known = lookup_btb(p, d->pc, &p->predicted_target);
+			break;
+		case OP_JR:
+			p->predicted_taken = true;
+			if(d->rs == 31 && p->ras_count)
+			{
+				p->ras_top = (p->ras_top + p->ras_depth - 1) % p->ras_depth;
+				p->ras_count--;
+				p->predicted_target = p->ras[p->ras_top];
+				p->target_known = true;
+			}
+			else if(d->rs != 31)
+				p->target_known = lookup_btb(p, d->pc, &p->predicted_target);
+			break;
+		default:
+			break;
+	}
+}
+
+/**********************************************************************
+ * resolve_prediction(m, d)
+ *
+ * DESCRIPTION
+ *   Check the prediction made for @d against where @d has gone, and train
+ *   the predictor of @m. Should be called right after executing @d.
+ *
+ * RETURN
+ *   The cycles flushed for the prediction
+ */
+static unsigned int resolve_prediction(struct machine *m, const struct decoded_instr *d)
+{
+	struct predictor *p = m->predictor;
+	int resolve_stage = m->pipeline ? m->pipeline->resolve_stage : STAGE_EX;
+	bool taken = m->pc != d->pc + WORD_SIZE;
+	bool target_right = p->target_known && p->predicted_target == m->pc;
+	unsigned int penalty = 0, index = (d->pc - p->start) / WORD_SIZE;
+
+	switch(d->op)
+	{
+		case OP_BEQ: case OP_BNE:
+			p->nr_branches++;
+			p->nr_taken += taken;
+			if(p->predicted_taken != taken)
+			{
+				p->nr_wrong_directions++;
+				penalty = resolve_stage - STAGE_IF;
+			}
+			else if(taken && !target_right)
+				penalty = STAGE_ID - STAGE_IF;
+			train_direction(p, d->pc, taken);
+			break;
+		case OP_J: case OP_JAL:
+			p->nr_jumps++;
+			if(!target_right)
+				penalty = STAGE_ID - STAGE_IF;
+			break;
+		case OP_JR:
+			if(d->rs == 31)
+			{
+				p->nr_returns++;
+				p->nr_wrong_returns += !target_right;
+			}
+			else
+			{
+				p->nr_indirects++;
+				p->nr_wrong_indirects += !target_right;
+			}
+			if(!target_right)
+				penalty = resolve_stage - STAGE_IF;
+			break;
+		default:
+			return 0;
+	}
+	if(taken && !(d->op == OP_JR && d->rs == 31))
+		update_btb(p, d->pc, m->pc);
+
+	p->penalty += penalty;
+	//text 영역 밖의 branch 는 전체 수에만 넣는다
+	if(d->pc - p->start < p->end - p->start)
+	{
+		p->executed[index]++;
+		p->mispredicted[index] += penalty > 0;
+		p->penalties[index] += penalty;
+	}
+	return penalty;
+}
+
+/**********************************************************************
+ * predictor_report(m, nr_lines)
+ *
+ * DESCRIPTION
+ *   Print the accuracy of the predictor of @m over the last run, and up to
+ *   @nr_lines branches which lost the most cycles.
+ */
+static void predictor_report(struct machine *m, size_t nr_lines)
+{
+	struct predictor *p = m->predictor;
+	struct profile_entry *entries;
+	size_t nr_entries = 0;
+
+	if(p == NULL || p->executed == NULL)
+	{
+		printf("No predictions. Run the program after 'predict on'\n");
+		return;
+	}
+
+	printf("Branch prediction (%s, %d-bit tables, %u BTB entries, %d RAS entries)\n",
+			predictor_names[p->kind], p->table_bits, p->nr_btb_entries, p->ras_depth);
+	if(p->nr_branches)
+		printf("  branches %14llu  %6.2f%% taken  %6.2f%% predicted right\n", p->nr_branches,
+				100.0 * p->nr_taken / p->nr_branches,
+				100.0 * (p->nr_branches - p->nr_wrong_directions) / p->nr_branches);
+	if(p->nr_jumps)
+		printf("  jumps    %14llu\n", p->nr_jumps);
+	if(p->nr_returns)
+		printf("  returns  %14llu  %6.2f%% predicted right\n", p->nr_returns,
+				100.0 * (p->nr_returns - p->nr_wrong_returns) / p->nr_returns);
+	if(p->nr_indirects)
+		printf("  jr       %14llu  %6.2f%% predicted right\n", p->nr_indirects,
+				100.0 * (p->nr_indirects - p->nr_wrong_indirects) / p->nr_indirects);
+	if(p->nr_btb_lookups)
+		printf("  BTB hits %14llu  %6.2f%%\n", p->nr_btb_hits, 100.0 * p->nr_btb_hits / p->nr_btb_lookups);
+	printf("  %llu cycles flushed\n", p->penalty);
+
+	if(p->start != m->text_start || p->end != m->text_end)
+		return;
+	entries = malloc(((p->end - p->start) / WORD_SIZE + 1) * sizeof(*entries));
+	if(entries == NULL)
+		return;
+	for(unsigned int i = 0; i < (p->end - p->start) / WORD_SIZE; i++)
+	{
+		if(p->penalties[i] == 0)
+			continue;
+		entries[nr_entries].pc = p->start + i * WORD_SIZE;
+		entries[nr_entries++].count = p->penalties[i];
+	}
+	qsort(entries, nr_entries, sizeof(*entries), compare_profile_entries);
+
+	printf("Mispredictions\n");
+	for(size_t i = 0; i < nr_entries && i < nr_lines; i++)
+	{
+		unsigned int index = (entries[i].pc - p->start) / WORD_SIZE;
+
+		printf("  0x%08x  %-8s executed %llu  mispredicted %llu  (%.2f%%)  %llu cycles\n",
+				entries[i].pc, profile_op_name(m, entries[i].pc), p->executed[index], p->mispredicted[index],
+				100.0 * p->mispredicted[index] / p->executed[index], entries[i].count);
+	}
+	free(entries);
+}
+
+/**********************************************************************
+ * setup_predictor(m, argc, argv)
+ *
+ * DESCRIPTION
+ *   Handle 'predict on [predictor] { -s bits } { -b entries } { -r depth }'.
+ *   The tables of the predictor have 2^@bits entries (12 by default), the
+ *   BTB @entries entries (512), and the RAS @depth entries (16). 0 entries
+ *   leave the BTB or the RAS out.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int setup_predictor(struct machine *m, int argc, char *argv[])
+{
+	int kind = PREDICT_GSHARE, table_bits = 12, ras_depth = 16;
+	unsigned int nr_btb_entries = 512;
+
+	for(int i = 2; i < argc; i++)
+	{
+		int k;
+
+		for(k = 0; k < NR_PREDICTORS && !strmatch(argv[i], predictor_names[k]); k++)
+			;
+		if(k < NR_PREDICTORS)
+			kind = k;
+		else if(strmatch(argv[i], "-s") && i + 1 < argc)
+			table_bits = strtoimax(argv[++i], NULL, 0);
+		else if(strmatch(argv[i], "-b") && i + 1 < argc)
+			nr_btb_entries = strtoimax(argv[++i], NULL, 0);
+		else if(strmatch(argv[i], "-r") && i + 1 < argc)
+			ras_depth = strtoimax(argv[++i], NULL, 0);
+		else
+		{
+			printf("Unknown predictor option %s\n", argv[i]);
+			return -1;
+		}
+	}
+	if(table_bits < 1 || table_bits > 24 || (nr_btb_entries & (nr_btb_entries - 1)) ||
+			ras_depth < 0 || ras_depth > MAX_RAS_DEPTH)
+	{
+		printf("Wrong predictor size. Up to 24 bits, power-of-two BTB entries, and up to %d RAS entries\n",
+				MAX_RAS_DEPTH);
+		return -1;
+	}
+
+	predictor_free(m);
+	m->predictor = calloc(1, sizeof(*m->predictor));
+	if(m->predictor == NULL)
+		return -1;
+	m->predictor->kind = kind;
+	m->predictor->table_bits = table_bits;
+	m->predictor->nr_btb_entries = nr_btb_entries;
+	m->predictor->ras_depth = ras_depth;
+	return predictor_reset(m);
+}
+
+
+/**********************************************************************
+ * Out-of-order model
+ *
+ * DESCRIPTION
+ *   'ooo on' times the run on a superscalar core scheduling the
+ *   instructions out of order like Tomasulo's algorithm, while the
+ *   instructions are still executed one at a time in the program order.
+ *   Since the executed instructions tell which registers and addresses they
+ *   use and where the branches went, the model only has to find when each
+ *   instruction would be
+ *
+ *   dispatched : Renamed into the reorder buffer (ROB) and a reservation
+ *                station (RS) of its class, up to @width a cycle in the
+ *                program order. Waits for a free ROB entry, a free RS, and
+ *                the fetch after a mispredicted branch
+ *   issued     : Sent to a functional unit of its class once its operands
+ *                are broadcast, leaving the RS. Each unit takes an
+ *                instruction a cycle
+ *   completed  : @latencies cycles later (plus the cycles of the cache
+ *                model for 'lw'), broadcasting the result
+ *   committed  : Retired from the ROB, up to @width a cycle in the program
+ *                order
+ *
+ *   A 'lw' waits for the latest 'sw' to the same word, which forwards the
+ *   value. The branches are predicted as in 'Branch prediction' if the
+ *   predictor is on, or not taken otherwise. A wrong direction or 'jr'
+ *   target is found when the branch completes, and a missing target of a
+ *   taken branch or a jump in decode; the fetch restarts from there and
+ *   reaches dispatch FRONTEND_CYCLES later. The cycles the cache model
+ *   takes for the instruction fetches and 'sw' hold the fetch instead, as
+ *   if the store buffer were always full.
+ *
+ *   The units are reserved on a calendar of CALENDAR_SIZE cycles, so
+ *   dependence chains running further ahead of dispatch may share a slot.
+ */
+#define MAX_WIDTH			8
+#define MAX_ROB_ENTRIES		1024
+#define MAX_RS_ENTRIES		64
+#define FRONTEND_CYCLES		2		/* From fetch to dispatch */
+#define CALENDAR_SIZE		(1 << 17)	/* Power of two */
+#define STORE_TABLE_SIZE	1024	/* Power of two */
+
+enum unit_classes {
+	UNIT_ALU = 0,
+	UNIT_MEM,
+	UNIT_BRANCH,
+	NR_UNIT_CLASSES,
+};
+
+static const char * const unit_names[NR_UNIT_CLASSES] = {
+	"alu", "mem", "branch",
+};
+
+enum dispatch_stalls {
+	DISPATCH_ROB = 0,
+	DISPATCH_RS,		/* + class */
+	DISPATCH_BRANCH = DISPATCH_RS + NR_UNIT_CLASSES,
+	DISPATCH_MEMORY,	/* Instruction fetches and 'sw' in the cache model */
+	NR_DISPATCH_STALLS,
+};
+
+/* Where the fetch after an instruction has been redirected */
+enum redirects {
+	REDIRECT_NONE = 0,
+	REDIRECT_DECODE,
+	REDIRECT_EXECUTE,
+};
+
+struct calendar_slot {
+	unsigned int cycle;		/* Lower 32 bits of the cycle of the slot */
+	unsigned char used;		/* Units taken in the cycle */
+};
+
+struct ooo {
+	int width;
+	int nr_rob_entries;
+	int nr_rs_entries;		/* For each class */
+	int nr_units[NR_UNIT_CLASSES];
+	int latencies[NR_UNIT_CLASSES];
+
+	unsigned int access_addr;	/* Of the 'lw' or 'sw' being executed */
+
+	unsigned long long last_dispatch;
+	unsigned long long next_fetch;		/* Earliest dispatch after a redirect or a fetch stall */
+	int fetch_cause;					/* Why @next_fetch is set. DISPATCH_BRANCH or DISPATCH_MEMORY */
+	unsigned long long dispatched[MAX_WIDTH];	/* Of the latest @width, by sequence */
+	unsigned long long committed[MAX_ROB_ENTRIES];	/* Of the latest ROB entries, by sequence */
+	unsigned long long last_commit;
+	unsigned long long rs_free[NR_UNIT_CLASSES][MAX_RS_ENTRIES];	/* When each RS is freed */
+	unsigned long long reg_ready[32];	/* When each register is broadcast */
+	unsigned int store_addrs[STORE_TABLE_SIZE];	/* Word address + 1 of the latest 'sw'. 0 if none */
+	unsigned long long store_ready[STORE_TABLE_SIZE];
+	struct calendar_slot *calendar[NR_UNIT_CLASSES];
+
+	unsigned long long nr_instructions;
+	unsigned long long stalls[NR_DISPATCH_STALLS];
+	unsigned long long nr_redirects;
+	unsigned long long commits_per_cycle[MAX_WIDTH + 1];
+	int nr_commits;				/* In @last_commit so far */
+};
+
+static void ooo_free(struct machine *m)
+{
+	if(m->ooo == NULL)
+		return;
+	for(int i = 0; i < NR_UNIT_CLASSES; i++)
+		free(m->ooo->calendar[i]);
+	free(m->ooo);
+	m->ooo = NULL;
+}
+
+static void ooo_reset(struct ooo *o)
+{
+	memset(o->dispatched, 0x00, sizeof(o->dispatched));
+	memset(o->committed, 0x00, sizeof(o->committed));
+	memset(o->rs_free, 0x00, sizeof(o->rs_free));
+	memset(o->reg_ready, 0x00, sizeof(o->reg_ready));
+	memset(o->store_addrs, 0x00, sizeof(o->store_addrs));
+	memset(o->stalls, 0x00, sizeof(o->stalls));
+	memset(o->commits_per_cycle, 0x00, sizeof(o->commits_per_cycle));
+	for(int i = 0; i < NR_UNIT_CLASSES; i++)
+		memset(o->calendar[i], 0x00, sizeof(*o->calendar[i]) * CALENDAR_SIZE);
+	//첫 instruction 은 FRONTEND_CYCLES 뒤에 dispatch 된다
+	o->last_dispatch = o->next_fetch = FRONTEND_CYCLES;
+	o->last_commit = 0;
+	o->nr_commits = 0;
+	o->nr_instructions = 0;
+	o->nr_redirects = 0;
+}
+
+static inline int unit_class(const struct decoded_instr *d)
+{
+	if(d->op == OP_LW || d->op == OP_SW)
+		return UNIT_MEM;
+	if(is_block_end[d->op])
+		return UNIT_BRANCH;
+	return UNIT_ALU;
+}
+
+/* Where the fetch after @d, which has just been executed, was redirected */
+static int fetch_redirect(struct machine *m, const struct decoded_instr *d)
+{
+	struct predictor *p = m->predictor;
+	bool taken = m->pc != d->pc + WORD_SIZE;
+	bool target_right = p && p->target_known && p->predicted_target == m->pc;
+
+	switch(d->op)
+	{
+		case OP_BEQ: case OP_BNE:
+			if(p ? p->predicted_taken != taken : taken)
+				return REDIRECT_EXECUTE;
+			return taken && !target_right ? REDIRECT_DECODE : REDIRECT_NONE;
+		case OP_J: case OP_JAL:
+			return target_right ? REDIRECT_NONE : REDIRECT_DECODE;
+		case OP_JR:
+			return target_right ? REDIRECT_NONE : REDIRECT_EXECUTE;
+		default:
+			return REDIRECT_NONE;
+	}
+}
+
+/* Take a unit of @class in the first cycle from @earliest with one free */
+static unsigned long long reserve_unit(struct ooo *o, int class, unsigned long long earliest)
+{
+	for(unsigned long long cycle = earliest; ; cycle++)
+	{
+		struct calendar_slot *slot = &o->calendar[class][cycle & (CALENDAR_SIZE - 1)];
+
+		if(slot->cycle != (unsigned int)cycle)
+		{
+			slot->cycle = cycle;
+			slot->used = 0;
+		}
+		if(slot->used < o->nr_units[class])
+		{
+			slot->used++;
+			return cycle;
+		}
+	}
+}
+
+/* Note @d is about to be executed. Should be called before executing @d */
+static inline void ooo_fetch(struct machine *m, const struct decoded_instr *d)
+{
+	if(d->op == OP_LW || d->op == OP_SW)
+		m->ooo->access_addr = m->registers[d->rs] + d->imm;
+}
+
+/**********************************************************************
+ * ooo_instruction(m, d, memory_stall)
+ *
+ * DESCRIPTION
+ *   Schedule @d on the out-of-order core of @m, where the accesses of @d
+ *   take @memory_stall cycles more in the cache model. Should be called
+ *   right after executing @d.
+ */
+static void ooo_instruction(struct machine *m, const struct decoded_instr *d, unsigned int memory_stall)
+{
+	struct ooo *o = m->ooo;
+	struct operand sources[2];
+	int dest, nr_sources = instruction_registers(d, sources, &dest);
+	int class = unit_class(d), rs = 0, cause = -1, redirect;
+	unsigned long long seq = o->nr_instructions++;
+	unsigned long long base, dispatch, ready, issue, complete, commit;
+	unsigned int store_slot = (o->access_addr / WORD_SIZE) & (STORE_TABLE_SIZE - 1);
+
+	//폭 만큼은 같은 cycle 에 dispatch 된다
+	base = o->last_dispatch;
+	if(seq >= (unsigned int)o->width && o->dispatched[seq % o->width] + 1 > base)
+		base = o->dispatched[seq % o->width] + 1;
+	dispatch = base;
+	if(o->next_fetch > dispatch)
+	{
+		dispatch = o->next_fetch;
+		cause = o->fetch_cause;
+	}
+	if(seq >= (unsigned int)o->nr_rob_entries && o->committed[seq % o->nr_rob_entries] > dispatch)
+	{
+		dispatch = o->committed[seq % o->nr_rob_entries];
+		cause = DISPATCH_ROB;
+	}
+	for(int i = 1; i < o->nr_rs_entries; i++)
+	{
+		if(o->rs_free[class][i] < o->rs_free[class][rs])
+			rs = i;
+	}
+	if(o->rs_free[class][rs] > dispatch)
+	{
+		dispatch = o->rs_free[class][rs];
+		cause = DISPATCH_RS + class;
+	}
+	if(cause >= 0)
+		o->stalls[cause] += dispatch - base;
+	o->last_dispatch = dispatch;
+	o->dispatched[seq % o->width] = dispatch;
+
+	//operand 가 모두 broadcast 된 다음 빈 unit 에 issue 한다
+	ready = dispatch + 1;
+	for(int i = 0; i < nr_sources; i++)
+	{
+		if(o->reg_ready[sources[i].reg] > ready)
+			ready = o->reg_ready[sources[i].reg];
+	}
+	if(d->op == OP_LW && o->store_addrs[store_slot] == o->access_addr / WORD_SIZE + 1 &&
+			o->store_ready[store_slot] > ready)
+		ready = o->store_ready[store_slot];
+	issue = reserve_unit(o, class, ready);
+	o->rs_free[class][rs] = issue;
+	complete = issue + o->latencies[class] + (d->op == OP_LW ? memory_stall : 0);
+	if(d->op != OP_LW && memory_stall && dispatch + memory_stall > o->next_fetch)
+	{
+		o->next_fetch = dispatch + memory_stall;
+		o->fetch_cause = DISPATCH_MEMORY;
+	}
+
+	if(dest)
+		o->reg_ready[dest] = complete;
+	if(d->op == OP_SW)
+	{
+		o->store_addrs[store_slot] = o->access_addr / WORD_SIZE + 1;
+		o->store_ready[store_slot] = complete;
+	}
+
+	redirect = fetch_redirect(m, d);
+	if(redirect != REDIRECT_NONE)
+		o->nr_redirects++;
+	if(redirect == REDIRECT_DECODE && dispatch + FRONTEND_CYCLES > o->next_fetch)
+	{
+		o->next_fetch = dispatch + FRONTEND_CYCLES;
+		o->fetch_cause = DISPATCH_BRANCH;
+	}
+	else if(redirect == REDIRECT_EXECUTE && complete + FRONTEND_CYCLES > o->next_fetch)
+	{
+		o->next_fetch = complete + FRONTEND_CYCLES;
+		o->fetch_cause = DISPATCH_BRANCH;
+	}
+
+	//commit 은 program 순서대로, 한 cycle 에 폭 만큼
+	commit = complete > o->last_commit ? complete : o->last_commit;
+	if(commit == o->last_commit && o->nr_commits == o->width)
+		commit++;
+	if(commit != o->last_commit)
+	{
+		if(o->last_commit)
+		{
+			o->commits_per_cycle[o->nr_commits]++;
+			o->commits_per_cycle[0] += commit - o->last_commit - 1;
+		}
+		else
+		{
+			//첫 commit 전의 cycle 들
+			o->commits_per_cycle[0] += commit - 1;
+		}
+		o->last_commit = commit;
+		o->nr_commits = 0;
+	}
+	o->nr_commits++;
+	o->committed[seq % o->nr_rob_entries] = commit;
+}
+
+/**********************************************************************
+ * ooo_report(m)
+ *
+ * DESCRIPTION
+ *   Print the cycles, IPC, the dispatch stalls by cause, and how many
+ *   instructions are committed a cycle over the last run.
+ */
+static void ooo_report(struct machine *m)
+{
+	struct ooo *o = m->ooo;
+	unsigned long long commits[MAX_WIDTH + 1], nr_stalls = 0, nr_cycles;
+
+	if(o == NULL || o->nr_instructions == 0)
+	{
+		printf("No out-of-order timing. Run the program after 'ooo on'\n");
+		return;
+	}
+	//마지막 cycle 까지 넣어서 센다
+	memcpy(commits, o->commits_per_cycle, sizeof(commits));
+	commits[o->nr_commits]++;
+	nr_cycles = o->last_commit;
+	for(int i = 0; i < NR_DISPATCH_STALLS; i++)
+		nr_stalls += o->stalls[i];
+
+	printf("Out-of-order core (%d-wide, %d ROB entries, %d RS entries, units %d:%d:%d, latencies %d:%d:%d)\n",
+			o->width, o->nr_rob_entries, o->nr_rs_entries,
+			o->nr_units[UNIT_ALU], o->nr_units[UNIT_MEM], o->nr_units[UNIT_BRANCH],
+			o->latencies[UNIT_ALU], o->latencies[UNIT_MEM], o->latencies[UNIT_BRANCH]);
+	printf("  %llu cycles for %llu instructions (IPC %.2f, CPI %.2f)\n", nr_cycles, o->nr_instructions,
+			(double)o->nr_instructions / nr_cycles, (double)nr_cycles / o->nr_instructions);
+	printf("  %llu redirected fetches\n", o->nr_redirects);
+
+	printf("Dispatch stalls (%llu cycles)\n", nr_stalls);
+	for(int i = 0; i < NR_DISPATCH_STALLS; i++)
+	{
+		char name[16];
+
+		if(o->stalls[i] == 0)
+			continue;
+		if(i == DISPATCH_ROB)
+			snprintf(name, sizeof(name), "rob");
+		else if(i == DISPATCH_BRANCH)
+			snprintf(name, sizeof(name), "branch");
+		else if(i == DISPATCH_MEMORY)
+			snprintf(name, sizeof(name), "memory");
+		else
+			snprintf(name, sizeof(name), "rs-%s", unit_names[i - DISPATCH_RS]);
+		printf("  %-10s %14llu  %6.2f%%\n", name, o->stalls[i], 100.0 * o->stalls[i] / nr_stalls);
+	}
+
+	printf("Commits per cycle\n");
+	for(int i = 0; i <= o->width; i++)
+		printf("  %-10d %14llu  %6.2f%%\n", i, commits[i], 100.0 * commits[i] / nr_cycles);
+}
+
+/* Parse "alu:mem:branch" of '-u' and '-l' options into @values */
+static int parse_classes(const char *spec, int values[NR_UNIT_CLASSES], int max)
+{
+	int v[NR_UNIT_CLASSES];
+
+	if(sscanf(spec, "%d:%d:%d", &v[UNIT_ALU], &v[UNIT_MEM], &v[UNIT_BRANCH]) != NR_UNIT_CLASSES)
+		return -1;
+	for(int i = 0; i < NR_UNIT_CLASSES; i++)
+	{
+		if(v[i] < 1 || v[i] > max)
+			return -1;
+		values[i] = v[i];
+	}
+	return 0;
+}
+
+/**********************************************************************
+ * setup_ooo(m, argc, argv)
+ *
+ * DESCRIPTION
+ *   Handle 'ooo on { -w width } { -r ROB entries } { -s RS entries }
+ *   { -u units } { -l latencies }', where the units and the latencies are
+ *   given for the classes as "alu:mem:branch". The core is 4-wide with 64
+ *   ROB entries, 16 RS entries for each class, 2:1:1 units, and 1:2:1
+ *   cycles by default.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int setup_ooo(struct machine *m, int argc, char *argv[])
+{
+	struct ooo config = {
+		.width = 4,
+		.nr_rob_entries = 64,
+		.nr_rs_entries = 16,
+		.nr_units = { [UNIT_ALU] = 2, [UNIT_MEM] = 1, [UNIT_BRANCH] = 1 },
+		.latencies = { [UNIT_ALU] = 1, [UNIT_MEM] = 2, [UNIT_BRANCH] = 1 },
+	};
+	int ret = 0;
+
+	for(int i = 2; i < argc && ret == 0; i++)
+	{
+		if(i + 1 == argc)
+			ret = -1;
+		else if(strmatch(argv[i], "-w"))
+			config.width = strtoimax(argv[++i], NULL, 0);
+		else if(strmatch(argv[i], "-r"))
+			config.nr_rob_entries = strtoimax(argv[++i], NULL, 0);
+		else if(strmatch(argv[i], "-s"))
+			config.nr_rs_entries = strtoimax(argv[++i], NULL, 0);
+		else if(strmatch(argv[i], "-u"))
+			ret = parse_classes(argv[++i], config.nr_units, UCHAR_MAX);
+		else if(strmatch(argv[i], "-l"))
+			ret = parse_classes(argv[++i], config.latencies, 1000);
+		else
+			ret = -1;
+	}
+	if(ret < 0 || config.width < 1 || config.width > MAX_WIDTH || config.nr_rob_entries < 1 ||
+			config.nr_rob_entries > MAX_ROB_ENTRIES || config.nr_rs_entries < 1 ||
+			config.nr_rs_entries > MAX_RS_ENTRIES)
+	{
+		printf("Wrong ooo options. Up to %d-wide, %d ROB entries, and %d RS entries\n",
+				MAX_WIDTH, MAX_ROB_ENTRIES, MAX_RS_ENTRIES);
+		return -1;
+	}
+
+	if(m->ooo == NULL)
+		m->ooo = calloc(1, sizeof(*m->ooo));
+	if(m->ooo == NULL)
+		return -1;
+	for(int i = 0; i < NR_UNIT_CLASSES; i++)
+	{
+		if(m->ooo->calendar[i] == NULL)
+			m->ooo->calendar[i] = malloc(sizeof(*m->ooo->calendar[i]) * CALENDAR_SIZE);
+		if(m->ooo->calendar[i] == NULL)
+		{
+			ooo_free(m);
+			return -1;
+		}
+		config.calendar[i] = m->ooo->calendar[i];
+	}
+	*m->ooo = config;
+	ooo_reset(m->ooo);
+	return 0;
+}
+
+
+/**********************************************************************
+ * process_instruction
+ *
+ * DESCRIPTION
+ *   Execute the machine code given through @instr. The following table lists
+ *   up the instructions to support. Note that a pseudo instruction 'halt'
+ *   (0xffffffff) is added for the testing purpose. Also '*' instrunctions are
+ *   the ones that are newly added to PA2.
+ *
+ * | Name   | Format    | Opcode / opcode + funct |
+ * | ------ | --------- | ----------------------- |
+ * | `add`  | r-format  | 0 + 0x20                |
+ * | `addi` | i-format  | 0x08                    |
+ * | `sub`  | r-format  | 0 + 0x22                |
+ * | `and`  | r-format  | 0 + 0x24                |
+ * | `andi` | i-format  | 0x0c                    |
+ * | `or`   | r-format  | 0 + 0x25                |
+ * | `ori`  | i-format  | 0x0d                    |
+ * | `nor`  | r-format  | 0 + 0x27                |
+ * | `sll`  | r-format  | 0 + 0x00                |
+ * | `srl`  | r-format  | 0 + 0x02                |
+ * | `sra`  | r-format  | 0 + 0x03                |
+ * | `lw`   | i-format  | 0x23                    |
+ * | `sw`   | i-format  | 0x2b                    |
+ * | `slt`  | r-format* | 0 + 0x2a                |
+ * | `slti` | i-format* | 0x0a                    |
+ * | `beq`  | i-format* | 0x04                    |
+ * | `bne`  | i-format* | 0x05                    |
+ * | `jr`   | r-format* | 0 + 0x08                |
+ * | `j`    | j-format* | 0x02                    |
+ * | `jal`  | j-format* | 0x03                    |
+ * | `halt` | special*  | @instr == 0xffffffff    |
+ *
+ * RETURN VALUE
+ *   1 if successfully processed the instruction.
+ *   0 if @instr is 'halt' or unknown instructions
+ */
+static int process_instruction(unsigned int instr)
+{
+	struct machine *m = &machine;
+	struct decoded_instr d;
+
+	decode_instruction(instr, m->pc - WORD_SIZE, &d);
+
+	if(execute_instruction(m, &d) == 0)
+		return 0;
+
+	if(trace_level == TRACE_FULL)
+		trace_instruction(m, &d);
+	return 1;
+}
+
+
+/**********************************************************************
+ * Program image
+ *
+ * DESCRIPTION
+ *   Parsing a large program in the hex text format takes a while. Thus
+ *   @load_program() also accepts binary program images, whose contents are
+ *   copied into @memory as they are. Every field is a 32-bit big-endian
+ *   word, and the segment contents are in the byte order of the machine.
+ *
+ *   offset  0 : IMAGE_MAGIC
+ *           4 : IMAGE_VERSION
+ *           8 : Entry PC
+ *          12 : Number of segments
+ *          16 : Segment table. Each segment has 4 fields;
+ *                +0 : Load address
+ *                +4 : Size in bytes
+ *                +8 : File offset of the contents
+ *               +12 : Flags. SEGMENT_TEXT if the segment holds instructions
+ *
+ *   The first text segment becomes the text region. 'convert' command turns
+ *   a program in the hex text format into an image.
+ */
+#define IMAGE_MAGIC			0x4d494d47	/* "MIMG" */
+#define IMAGE_VERSION		1
+#define IMAGE_HEADER_SIZE	16
+#define IMAGE_SEGMENT_SIZE	16
+#define SEGMENT_TEXT		0x1
+
+static inline unsigned int get_be32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void put_be32(unsigned char *p, unsigned int word)
+{
+	p[0] = word >> 24;
+	p[1] = word >> 16;
+	p[2] = word >> 8;
+	p[3] = word;
+}
+
+/**********************************************************************
+ * map_file(filename, size)
+ *
+ * DESCRIPTION
+ *   Map the file @filename read-only, and store its size into @size. The
+ *   file is read into a buffer on the systems without mmap().
+ *
+ * RETURN
+ *   The contents of the file, which should be released with unmap_file()
+ *   NULL on failure
+ */
+static const unsigned char *map_file(const char *filename, size_t *size)
+{
+#ifndef _WIN32
+	struct stat st;
+	void *map;
+	int fd = open(filename, O_RDONLY);
+
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	*size = st.st_size;
+	return map;
+#else
+	unsigned char *buffer;
+	long length;
+	FILE *file = fopen(filename, "rb");
+
+	if(file == NULL)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	rewind(file);
+
+	buffer = length > 0 ? malloc(length) : NULL;
+	if(buffer == NULL || fread(buffer, 1, length, file) != (size_t)length)
+	{
+		free(buffer);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+
+	*size = length;
+	return buffer;
+#endif
+}
+
+static void unmap_file(const unsigned char *contents, size_t size)
+{
+#ifndef _WIN32
+	munmap((void *)contents, size);
+#else
+	free((void *)contents);
+#endif
+}
+
+/**********************************************************************
+ * load_image(filename)
+ *
+ * DESCRIPTION
+ *   Load the program image @filename onto the memory of @m.
+ *
+ * RETURN
+ *	 0 on successfully load the program
+ *	 any other value otherwise
+ */
+static int load_image(struct machine *m, const char *filename)
+{
+	const unsigned char *image, *segment;
+	size_t size;
+	unsigned int nr_segments;
+	unsigned int text_from = 0, text_to = 0;
+	bool has_text = false;
+	int ret = EXIT_FAILURE;
+
+	image = map_file(filename, &size);
+	if(image == NULL)
+	{
+		fprintf(stderr, "No input file\n");
+		return EXIT_FAILURE;
+	}
+
+	if(size < IMAGE_HEADER_SIZE || get_be32(image) != IMAGE_MAGIC ||
+			get_be32(image + 4) != IMAGE_VERSION)
+		goto invalid;
+
+	nr_segments = get_be32(image + 12);
+	if(nr_segments > (size - IMAGE_HEADER_SIZE) / IMAGE_SEGMENT_SIZE)
+		goto invalid;
+
+	for(unsigned int i = 0; i < nr_segments; i++)
+	{
+		unsigned int addr, length, offset, flags;
+
+		segment = image + IMAGE_HEADER_SIZE + i * IMAGE_SEGMENT_SIZE;
+		addr = get_be32(segment);
+		length = get_be32(segment + 4);
+		offset = get_be32(segment + 8);
+		flags = get_be32(segment + 12);
+
+		if(offset > size || length > size - offset || addr + (unsigned long long)length > (1ULL << 32))
+			goto invalid;
+
+		if(mem_write_bytes(&m->memory, addr, image + offset, length))
+		{
+			fprintf(stderr, "Memory fault at 0x%08x\n", m->memory.fault_addr);
+			goto out;
+		}
+
+		if((flags & SEGMENT_TEXT) && !has_text)
+		{
+			text_from = addr;
+			text_to = addr + (length & ~(WORD_SIZE - 1));
+			has_text = true;
+		}
+	}
+
+	m->entry_pc = get_be32(image + 8);
+	ret = has_text ? decode_text(m, text_from, text_to) : decode_text(m, m->entry_pc, m->entry_pc);
+	goto out;
+
+invalid:
+	fprintf(stderr, "Invalid program image %s\n", filename);
+out:
+	unmap_file(image, size);
+	return ret;
+}
+
+/**********************************************************************
+ * convert_program(filename, image_filename)
+ *
+ * DESCRIPTION
+ *   Convert the program @filename in the hex text format into a program
+ *   image @image_filename which has one text segment at @INITIAL_PC. Like
+ *   @load_program(), 'halt' is appended unless the program ends with it.
+ *
+ * RETURN
+ *	 0 on success
+ *	 any other value otherwise
+ */
+static int convert_program(char * const filename, char * const image_filename)
+{
+	char buffer[200];
+	unsigned char *text = NULL;
+	size_t nr_words = 0, capacity = 0;
+	unsigned char header[IMAGE_HEADER_SIZE + IMAGE_SEGMENT_SIZE];
+	unsigned int last = 0;
+	FILE *input, *output;
+	int ret = EXIT_FAILURE;
+
+	input = fopen(filename, "r");
+	if(input == NULL)
+	{
+		fprintf(stderr, "No input file\n");
+		return EXIT_FAILURE;
+	}
+
+	while(1)
+	{
+		bool eof = fgets(buffer, sizeof(buffer), input) == NULL;
+
+		if(eof && last == 0xffffffff)
+			break;
+
+		if(nr_words == capacity)
+		{
+			unsigned char *grown;
+
+			capacity = capacity ? capacity * 2 : 1024;
+			grown = realloc(text, capacity * WORD_SIZE);
+			if(grown == NULL)
+			{
+				fprintf(stderr, "Cannot allocate the program image\n");
+				goto out;
+			}
+			text = grown;
+		}
+
+		//파일 끝에 halt문이 없으면 추가.
+		last = eof ? 0xffffffff : (unsigned int)strtol(buffer, NULL, 16);
+		put_be32(&text[nr_words * WORD_SIZE], last);
+		nr_words++;
+
+		if(eof)
+			break;
+	}
+
+	put_be32(header, IMAGE_MAGIC);
+	put_be32(header + 4, IMAGE_VERSION);
+	put_be32(header + 8, INITIAL_PC);
+	put_be32(header + 12, 1);
+	put_be32(header + 16, INITIAL_PC);
+	put_be32(header + 20, nr_words * WORD_SIZE);
+	put_be32(header + 24, sizeof(header));
+	put_be32(header + 28, SEGMENT_TEXT);
+
+	output = fopen(image_filename, "wb");
+	if(output == NULL)
+	{
+		fprintf(stderr, "Cannot create %s\n", image_filename);
+		goto out;
+	}
+	if(fwrite(header, sizeof(header), 1, output) == 1 &&
+			fwrite(text, WORD_SIZE, nr_words, output) == nr_words)
+		ret = 0;
+	else
+		fprintf(stderr, "Cannot write %s\n", image_filename);
+	fclose(output);
+
+out:
+	fclose(input);
+	free(text);
+	return ret;
+}
+
+
+/**********************************************************************
+ * load_program(filename)
+ *
+ * DESCRIPTION
+ *   Load the instructions in the file @filename onto the memory starting at
+ *   @INITIAL_PC. Each line in the program file looks like;
+ *
+ *	 [MIPS instruction started with 0x prefix]  // optional comments
+ *
+ *   For example,
+ *
+ *   0x8c090008
+ *   0xac090020	// sw t1, zero + 32
+ *   0x8c080000
+ *
+ *   implies three MIPS instructions to load. Each machine instruction may
+ *   be followed by comments like the second instruction. However you can simply
+ *   call strtoimax(linebuffer, NULL, 0) to read the machine code while
+ *   ignoring the comment parts.
+ *
+ *	 The program DOES NOT include the 'halt' instruction. Thus, make sure the
+ *	 'halt' instruction is appended to the loaded instructions to terminate
+ *	 your program properly.
+ *
+ *	 Refer to the @main() for reading data from files. (fopen, fgets, fclose).
+ *
+ *   If @filename is a program image, it is loaded by @load_image() instead.
+ *
+ *   load_machine() loads the program onto the machine @m, and
+ *   @load_program() onto @machine of the command interpreter.
+ *
+ * RETURN
+ *	 0 on successfully load the program
+ *	 any other value otherwise
+ */
+
+static int load_machine(struct machine *m, char * const filename)
+{
+
+	char buffer[200];
+	long long temp;
+
+	int num = 0;
+	FILE *input = stdin;
+
+	input = fopen(filename, "r");
+
+	if (input == NULL)
+	{
+		fprintf(stderr, "No input file\n");
+		return EXIT_FAILURE;
+	}
+
+	//image 파일이면 통째로 올린다.
+	unsigned char magic[4];
+	if(fread(magic, sizeof(magic), 1, input) == 1 && get_be32(magic) == IMAGE_MAGIC)
+	{
+		fclose(input);
+		return load_image(m, filename);
+	}
+	rewind(input);
+
+	int index = INITIAL_PC;
+
+	while(fgets(buffer, sizeof(buffer), input) != NULL)
+	{
+		temp = strtol(buffer, NULL, 16);
+
+		if(mem_write_word(&m->memory, index, temp))
+		{
+			fprintf(stderr, "Memory fault at 0x%08x\n", index);
+			fclose(input);
+			return EXIT_FAILURE;
+		}
+		index = index + WORD_SIZE;
+	}
+
+	temp = strtol(buffer, NULL, 16);
+	//문장 끝에 halt문이 없으면 추가.
+	if(temp != 0xffffffff)
+	{
+		if(mem_write_word(&m->memory, index, 0xffffffff))
+		{
+			fprintf(stderr, "Memory fault at 0x%08x\n", index);
+			fclose(input);
+			return EXIT_FAILURE;
+		}
+		index = index + WORD_SIZE;
+	}
+	if(input != stdin)
+		fclose(input);
+
+	//한 번만 decode 해둔다.
+	m->entry_pc = INITIAL_PC;
+	return decode_text(m, INITIAL_PC, index);
+}
+
+static int load_program(char * const filename)
+{
+	return load_machine(&machine, filename);
+}
+
+
+/**********************************************************************
+ * fetch_decoded(addr, scratch)
+ *
+ * DESCRIPTION
+ *   Return the decoded record of the instruction at @addr. Instructions
+ *   out of the text region are decoded into @scratch on the fly.
+ */
+static inline const struct decoded_instr *fetch_decoded(struct machine *m, unsigned int addr, struct decoded_instr *scratch)
+{
+	if(addr >= m->text_start && addr < m->text_end && (addr % WORD_SIZE) == 0)
+		return &m->text_decoded[(addr - m->text_start) / WORD_SIZE];
+
+	decode_instruction(fetch_instruction(m, addr), addr, scratch);
+	return scratch;
+}
+
+/**********************************************************************
+ * elapsed_seconds(from)
+ *
+ * DESCRIPTION
+ *   Return the wall-clock time passed since @from in seconds.
+ */
+static double elapsed_seconds(const struct timespec *from)
+{
+	struct timespec now;
+
+	timespec_get(&now, TIME_UTC);
+	return (now.tv_sec - from->tv_sec) + (now.tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/**********************************************************************
+ * Watchdog
+ *
+ * DESCRIPTION
+ *   A run stops on its own once it has retired @max_instructions or has
+ *   run for @max_seconds, so that a program looping forever does not hang
+ *   the emulator. The run loops compare the number of retired instructions
+ *   with the count returned by @watchdog_start(m) or
+ *   @watchdog_check(m, nr_retired) at the end of every basic block, and
+ *   only look at the clock every WATCHDOG_INTERVAL instructions. Thus the
+ *   fast loops may retire a few instructions more than @max_instructions
+ *   to finish the current block.
+ *
+ *   When stopped, @pc points to the next instruction to run and @stopped
+ *   tells why, so the run can be resumed later (see 'resume' command).
+ */
+#define WATCHDOG_INTERVAL	(1 << 16)
+
+/**********************************************************************
+ * watchdog_check(m, nr_retired)
+ *
+ * DESCRIPTION
+ *   Check the limits of @m after @nr_retired instructions.
+ *
+ * RETURN
+ *   The number of retired instructions to check the limits again at
+ *   0 if the run should stop
+ */
+static unsigned long long watchdog_check(struct machine *m, unsigned long long nr_retired)
+{
+	unsigned long long next = ULLONG_MAX;
+
+	if(m->max_instructions && nr_retired >= m->max_instructions)
+	{
+		m->stopped = STOP_LIMIT;
+		return 0;
+	}
+	if(m->max_seconds > 0)
+	{
+		if(nr_retired && elapsed_seconds(&m->started) >= m->max_seconds)
+		{
+			m->stopped = STOP_TIMEOUT;
+			return 0;
+		}
+		next = nr_retired + WATCHDOG_INTERVAL;
+	}
+	if(m->max_instructions && next > m->max_instructions)
+		next = m->max_instructions;
+	return next;
+}
+
+static unsigned long long watchdog_start(struct machine *m)
+{
+	m->stopped = STOP_HALT;
+	timespec_get(&m->started, TIME_UTC);
+	return watchdog_check(m, 0);
+}
+
+#ifdef USE_THREADED_DISPATCH
+/**********************************************************************
+ * run_threaded
+ *
+ * DESCRIPTION
+ *   Threaded version of @run_fast(m). Each handler jumps straight to the
+ *   handler of the next instruction through @labels[] instead of returning
+ *   to a central loop, so every handler gets its own indirect branch.
+ *
+ * RETURN
+ *   The number of retired instructions
+ */
+static unsigned long long run_threaded(struct machine *m)
+{
+	static void * const labels[NR_OPS] = {
+		[OP_INVALID] = &&do_halt,
+		[OP_ADD] = &&do_add,
+		[OP_ADDI] = &&do_addi,
+		[OP_SUB] = &&do_sub,
+		[OP_AND] = &&do_and,
+		[OP_ANDI] = &&do_andi,
+		[OP_OR] = &&do_or,
+		[OP_ORI] = &&do_ori,
+		[OP_NOR] = &&do_nor,
+		[OP_SLL] = &&do_sll,
+		[OP_SRL] = &&do_srl,
+		[OP_SRA] = &&do_sra,
+		[OP_LW] = &&do_lw,
+		[OP_SW] = &&do_sw,
+		[OP_SLT] = &&do_slt,
+		[OP_SLTI] = &&do_slti,
+		[OP_BEQ] = &&do_beq,
+		[OP_BNE] = &&do_bne,
+		[OP_JR] = &&do_jr,
+		[OP_J] = &&do_j,
+		[OP_JAL] = &&do_jal,
+		[OP_HALT] = &&do_halt,
+	};
+	const struct decoded_instr *d;
+	struct decoded_instr decoded;
+	unsigned long long nr_retired = 0;
+	unsigned long long check_at = watchdog_start(m);
+
+#define DISPATCH() do { \
+		d = fetch_decoded(m, m->pc, &decoded); \
+		m->pc += 0x4; \
+		nr_retired++; \
+		goto *labels[d->op]; \
+	} while (0)
+
+	/* At the end of a block */
+#define DISPATCH_CHECKED() do { \
+		if(nr_retired >= check_at && (check_at = watchdog_check(m, nr_retired)) == 0) \
+			return nr_retired; \
+		DISPATCH(); \
+	} while (0)
+
+	DISPATCH();
+
+do_add:
+	op_add(m, d);
+	DISPATCH();
+
+do_addi:
+	op_addi(m, d);
+	DISPATCH();
+
+do_sub:
+	op_sub(m, d);
+	DISPATCH();
+
+do_and:
+	op_and(m, d);
+	DISPATCH();
+
+do_andi:
+	op_andi(m, d);
+	DISPATCH();
+
+do_or:
+	op_or(m, d);
+	DISPATCH();
+
+do_ori:
+	op_ori(m, d);
+	DISPATCH();
+
+do_nor:
+	op_nor(m, d);
+	DISPATCH();
+
+do_sll:
+	op_sll(m, d);
+	DISPATCH();
+
+do_srl:
+	op_srl(m, d);
+	DISPATCH();
+
+do_sra:
+	op_sra(m, d);
+	DISPATCH();
+
+do_lw:
+	op_lw(m, d);
+	DISPATCH();
+
+do_sw:
+	if(op_sw(m, d) == 0)
+		return nr_retired - 1;
+	DISPATCH();
+
+do_slt:
+	op_slt(m, d);
+	DISPATCH();
+
+do_slti:
+	op_slti(m, d);
+	DISPATCH();
+
+do_beq:
+	op_beq(m, d);
+	DISPATCH_CHECKED();
+
+do_bne:
+	op_bne(m, d);
+	DISPATCH_CHECKED();
+
+do_jr:
+	op_jr(m, d);
+	DISPATCH_CHECKED();
+
+do_j:
+	op_j(m, d);
+	DISPATCH_CHECKED();
+
+do_jal:
+	op_jal(m, d);
+	DISPATCH_CHECKED();
+
+do_halt:
+	return nr_retired - 1;
+
+#undef DISPATCH_CHECKED
+#undef DISPATCH
+}
+#endif
+
+#ifndef USE_THREADED_DISPATCH
+/**********************************************************************
+ * translate_block(block)
+ *
+ * DESCRIPTION
+ *   Translate the basic block starting at the slot of @block.
+ */
+static void translate_block(struct machine *m, struct basic_block *block)
+{
+	const struct decoded_instr *d = &m->text_decoded[block - m->text_blocks];
+	const struct decoded_instr *end = &m->text_decoded[(m->text_end - m->text_start) / WORD_SIZE];
+
+	block->first = d;
+	while(d + 1 < end && !is_block_end[d->op])
+	{
+		d++;
+	}
+	block->last = d;
+	block->next[0] = block->next[1] = NULL;
+	block->valid = true;
+}
+
+/**********************************************************************
+ * lookup_block(addr)
+ *
+ * DESCRIPTION
+ *   Find the basic block starting at @addr.
+ *
+ * RETURN
+ *   The block if @addr is in the text region
+ *   NULL otherwise
+ */
+static inline struct basic_block *lookup_block(struct machine *m, unsigned int addr)
+{
+	if(addr >= m->text_start && addr < m->text_end && (addr % WORD_SIZE) == 0)
+		return &m->text_blocks[(addr - m->text_start) / WORD_SIZE];
+	return NULL;
+}
+
+/**********************************************************************
+ * run_blocks
+ *
+ * DESCRIPTION
+ *   Run the program from @pc block by block. After a block ends, the next
+ *   block is taken from the links of the block if it has been there before.
+ *   Instructions out of the text region are executed one by one.
+ *
+ * RETURN
+ *   The number of retired instructions
+ */
+static unsigned long long run_blocks(struct machine *m)
+{
+	struct basic_block *block = lookup_block(m, m->pc);
+	unsigned long long nr_retired = 0;
+	unsigned long long check_at = watchdog_start(m);
+
+	while(1)
+	{
+		if(nr_retired >= check_at && (check_at = watchdog_check(m, nr_retired)) == 0)
+			return nr_retired;
+
+		const struct decoded_instr *d;
+		struct basic_block *next;
+		int ret = 1;
+
+		if(block == NULL)
+		{
+			struct decoded_instr decoded;
+
+			decode_instruction(fetch_instruction(m, m->pc), m->pc, &decoded);
+			m->pc += 0x4;
+			if(execute_instruction(m, &decoded) == 0)
+				return nr_retired;
+			nr_retired++;
+			block = lookup_block(m, m->pc);
+			continue;
+		}
+
+		if(!block->valid)
+			translate_block(m, block);
+
+		for(d = block->first; d < block->last; d++)
+		{
+			if((ret = execute_instruction(m, d)) != 1)
+				break;
+		}
+
+		m->pc = d->pc + 0x4;
+		if(ret == 1)
+		{
+			//block의 마지막 branch/jump
+			ret = execute_instruction(m, d);
+		}
+		if(ret == 0)
+		{
+			nr_retired += d - block->first;
+			return nr_retired;
+		}
+		nr_retired += d - block->first + 1;
+
+		//text 영역이 바뀌었으면 link는 쓰지 않는다.
+		if(ret == 2)
+		{
+			block = lookup_block(m, m->pc);
+			continue;
+		}
+
+		if(block->next[0] != NULL && block->next[0]->first->pc == m->pc)
+		{
+			block = block->next[0];
+			continue;
+		}
+		if(block->next[1] != NULL && block->next[1]->first->pc == m->pc)
+		{
+			next = block->next[1];
+			block->next[1] = block->next[0];
+			block->next[0] = next;
+			block = next;
+			continue;
+		}
+
+		next = lookup_block(m, m->pc);
+		if(next != NULL)
+		{
+			if(!next->valid)
+				translate_block(m, next);
+			block->next[1] = block->next[0];
+			block->next[0] = next;
+		}
+		block = next;
+	}
+}
+#endif
+
+/**********************************************************************
+ * run_fast
+ *
+ * DESCRIPTION
+ *   Run the program from @pc until it halts without any tracing.
+ *
+ * RETURN
+ *   The number of retired instructions
+ */
+static unsigned long long run_fast(struct machine *m)
+{
+#ifdef USE_THREADED_DISPATCH
+	return run_threaded(m);
+#else
+	return run_blocks(m);
+#endif
+}
+
+/**********************************************************************
+ * run_stepped
+ *
+ * DESCRIPTION
+ *   Run the program from @pc until it halts one instruction at a time, so
+ *   that every instruction can be printed, profiled, and timed.
+ *
+ * RETURN
+ *   The number of retired instructions
+ */
+static unsigned long long run_stepped(struct machine *m)
+{
+	const struct decoded_instr *d;
+	struct decoded_instr decoded;
+	unsigned long long nr_retired = 0;
+	unsigned long long check_at = watchdog_start(m);
+	unsigned int memory_stall = 0, flush = 0;
+	bool trace = trace_level == TRACE_FULL;
+
+	while(1)
+	{
+		if(nr_retired >= check_at && (check_at = watchdog_check(m, nr_retired)) == 0)
+			return nr_retired;
+
+		//1. load. text 영역은 미리 decode 된 것을 쓴다.
+		d = fetch_decoded(m, m->pc, &decoded);
+
+		if(trace)
+			printf("load pc address : %0x\t\t", m->pc);
+		if(m->predictor)
+			predict_fetch(m, d);
+		if(m->ooo)
+			ooo_fetch(m, d);
+		//2. increment @pc
+		m->pc += 0x4;
+
+		//3. call @proces and repeat.s
+#ifdef USE_CACHE_MODEL
+		if(cache_model)
+			memory_stall = model_instruction(m, d);
+#endif
+		if(execute_instruction(m, d) == 0)
+			return nr_retired;
+		if(trace)
+			trace_instruction(m, d);
+		if(m->profile)
+			profile_instruction(m, d);
+		if(m->predictor)
+			flush = resolve_prediction(m, d);
+		else if(m->pipeline)
+			flush = not_taken_penalty(m, d, m->pipeline->resolve_stage);
+		if(m->pipeline)
+			pipeline_instruction(m, d, memory_stall, flush);
+		if(m->ooo)
+			ooo_instruction(m, d, memory_stall);
+		nr_retired++;
+	}
+}
+
+/**********************************************************************
+ * resume_program
+ *
+ * DESCRIPTION
+ *   Continue running the program from @pc, e.g., after the run has been
+ *   stopped by the watchdog or a checkpoint has been restored.
+ *
+ * RETURN
+ *   0
+ */
+static int resume_program(void)
+{
+	struct machine *m = &machine;
+	struct timespec start;
+	unsigned long long nr_retired;
+	double seconds;
+
+	m->memory.faulted = false;
+
+	//text 영역이 바뀌었으면 profile 을 새로 시작한다
+	if(m->profile && (m->profile->counts == NULL || m->profile->start != m->text_start ||
+				m->profile->end != m->text_end) && profile_reset(m) < 0)
+		return 0;
+	if(m->predictor && (m->predictor->start != m->text_start || m->predictor->end != m->text_end) &&
+			predictor_reset(m) < 0)
+		return 0;
+
+	timespec_get(&start, TIME_UTC);
+	if(trace_level == TRACE_FULL || m->profile || cache_model || m->pipeline || m->predictor || m->ooo)
+		nr_retired = run_stepped(m);
+	else
+		nr_retired = run_fast(m);
+	seconds = elapsed_seconds(&start);
+#ifdef USE_CACHE_MODEL
+	if(cache_model)
+		cache_model_instructions += nr_retired;
+#endif
+
+	if(m->memory.faulted)
+		fprintf(stderr, "Memory fault at 0x%08x (pc 0x%08x)\n", m->memory.fault_addr, m->pc - WORD_SIZE);
+	if(m->stopped == STOP_LIMIT)
+		fprintf(stderr, "Stopped at pc 0x%08x after %llu instructions\n", m->pc, nr_retired);
+	else if(m->stopped == STOP_TIMEOUT)
+		fprintf(stderr, "Stopped at pc 0x%08x after %.2f seconds\n", m->pc, seconds);
+
+	if(trace_level >= TRACE_SUMMARY)
+	{
+		//full trace는 그대로 diff 할 수 있게 시간이 들어간 줄은 stderr로 보낸다
+		fprintf(trace_level == TRACE_FULL ? stderr : stdout, "%llu instructions retired in %.6f s (%.2f MIPS)\n",
+				nr_retired, seconds, seconds > 0 ? nr_retired / seconds / 1e6 : 0.0);
+		if(m->profile)
+			profile_report(m, 10);
+		if(m->pipeline)
+			pipeline_report(m);
+		if(m->predictor)
+			predictor_report(m, 10);
+		if(m->ooo)
+			ooo_report(m);
+#ifdef USE_CACHE_MODEL
+		if(cache_model)
+			report_cycles();
+#endif
+	}
+	return 0;
+}
+
+/**********************************************************************
+ * run_program
+ *
+ * DESCRIPTION
+ *   Start running the program that is loaded by @load_program function above.
+ *   If you implement @load_program() properly, the first instruction is placed
+ *   at @entry_pc, which is @INITIAL_PC unless a program image says otherwise.
+ *   Using @pc, which is the program counter of this processor,
+ *   you can emulate the MIPS processor by
+ *
+ *   1. Read instruction from @pc
+ *   2. Increment @pc by 4
+ *   3. Call @process_instruction(instruction)
+ *   4. Repeat until @process_instruction() returns 0
+ *
+ *   Instructions in the text region are not read from @memory but taken
+ *   from @text_decoded, which is built by @load_program(). How much is
+ *   printed during and after the run depends on @trace_level. The program
+ *   runs through @run_stepped(m) when every instruction has to be seen, that
+ *   is, when tracing in full, profiling, predicting the branches, or running
+ *   on the cache model, the pipeline model, or the out-of-order model.
+ *
+ * RETURN
+ *   0
+ */
+static int run_program(void)
+{
+	struct machine *m = &machine;
+
+	m->pc = m->entry_pc;
+	if(m->profile && profile_reset(m) < 0)
+		return 0;
+	if(m->pipeline)
+		pipeline_reset(m->pipeline);
+	if(m->predictor && predictor_reset(m) < 0)
+		return 0;
+	if(m->ooo)
+		ooo_reset(m->ooo);
+#ifdef USE_CACHE_MODEL
+	if(cache_model)
+	{
+		if(reset_cache_model() < 0)
+			return 0;
+		cache_model_instructions = 0;
+	}
+#endif
 
-			return 1;
-		}
-		else if(funct == 0x08) //jr
-		{
-			pc = registers[rs];
-			printf("jr // rs pc\t %x %x\n", registers[rs], pc);
+	return resume_program();
+}
 
-			return 1;
-		}
-	}
-	//j-instruction
-	else if(opcode == 0x02)		//j
-	{
-		int address;
 
-		address = instr % (1 << 26);
+/**********************************************************************
+ * Checkpoint
+ *
+ * DESCRIPTION
+ *   'checkpoint' command saves the state of @machine into a file, and
+ *   'restore' command brings it back so that a long run can be continued
+ *   with 'resume' instead of running again from the entry. Like the program
+ *   images, every field is a 32-bit big-endian word;
+ *
+ *   offset  0 : CHECKPOINT_MAGIC
+ *           4 : CHECKPOINT_VERSION
+ *           8 : @pc
+ *          12 : @entry_pc
+ *          16 : @text_start
+ *          20 : @text_end
+ *          24 : Number of pages
+ *          28 : @registers[0] ... @registers[31]
+ *         156 : Pages. Each page is its address followed by PAGE_SIZE bytes
+ *
+ *   Only the pages the program has touched are saved.
+ */
+#define CHECKPOINT_MAGIC		0x4d434b50	/* "MCKP" */
+#define CHECKPOINT_VERSION		1
+#define CHECKPOINT_HEADER_SIZE	(28 + 32 * 4)
 
-		pc = ((pc >> 28) << 28) + (address << 2);
-		printf("j // instruction pc input : %x\n", pc);
+/**********************************************************************
+ * save_checkpoint(m, filename)
+ *
+ * DESCRIPTION
+ *   Save the registers, @pc, the text region, and the pages of @m into
+ *   @filename.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int save_checkpoint(struct machine *m, const char *filename)
+{
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+	unsigned char addr[4];
+	FILE *output = fopen(filename, "wb");
 
-		return 1;
-	}
-	else if(opcode == 0x03)		//jal
+	if(output == NULL)
 	{
-		int address;
+		fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
 
-		address = instr % (1 << 26);
+	put_be32(header, CHECKPOINT_MAGIC);
+	put_be32(header + 4, CHECKPOINT_VERSION);
+	put_be32(header + 8, m->pc);
+	put_be32(header + 12, m->entry_pc);
+	put_be32(header + 16, m->text_start);
+	put_be32(header + 20, m->text_end);
+	put_be32(header + 24, m->memory.nr_pages);
+	for(int i = 0; i < 32; i++)
+	{
+		put_be32(header + 28 + i * 4, m->registers[i]);
+	}
+	fwrite(header, sizeof(header), 1, output);
 
-		registers[31] = pc;
+	for(unsigned int i = 0; i < NR_PTES; i++)
+	{
+		if(m->memory.directory[i] == NULL)
+			continue;
+		for(unsigned int j = 0; j < NR_PTES; j++)
+		{
+			if(m->memory.directory[i][j] == NULL)
+				continue;
+			put_be32(addr, (i * NR_PTES + j) << PAGE_SHIFT);
+			fwrite(addr, sizeof(addr), 1, output);
+			fwrite(m->memory.directory[i][j], PAGE_SIZE, 1, output);
+		}
+	}
 
-		pc = ((pc >> 28) << 28) + (address << 2);
-		
-		printf("jal // ra : %x   pc : %x\n", registers[31], pc);
-		return 1;
+	if(ferror(output) | fclose(output))
+	{
+		fprintf(stderr, "Unable to write %s\n", filename);
+		return -1;
 	}
-	else
+	return 0;
+}
+
+/**********************************************************************
+ * restore_checkpoint(m, filename)
+ *
+ * DESCRIPTION
+ *   Replace the state of @m with the one saved in @filename. @m is left
+ *   untouched if the file is not a valid checkpoint.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int restore_checkpoint(struct machine *m, const char *filename)
+{
+	const unsigned char *checkpoint;
+	size_t size;
+	unsigned int nr_pages, text_start, text_end;
+	int ret = -1;
+
+	checkpoint = map_file(filename, &size);
+	if(checkpoint == NULL)
 	{
-		int temp = 0;
-		int rs, rt, address;
+		fprintf(stderr, "No input file\n");
+		return -1;
+	}
 
-		address = instr % (1 << 16);
-		instr = instr / (1 << 16);
+	if(size < CHECKPOINT_HEADER_SIZE || get_be32(checkpoint) != CHECKPOINT_MAGIC ||
+			get_be32(checkpoint + 4) != CHECKPOINT_VERSION)
+		goto invalid;
 
-		rt = instr % (1 << 5);
-		instr = instr / (1 << 5);
+	text_start = get_be32(checkpoint + 16);
+	text_end = get_be32(checkpoint + 20);
+	nr_pages = get_be32(checkpoint + 24);
+	if(text_start > text_end || (text_start % WORD_SIZE) || (text_end % WORD_SIZE) ||
+			(size - CHECKPOINT_HEADER_SIZE) / (4 + PAGE_SIZE) != nr_pages ||
+			(size - CHECKPOINT_HEADER_SIZE) % (4 + PAGE_SIZE))
+		goto invalid;
 
-		rs = instr % (1 << 5);
-		instr = instr / (1 << 5);
-		
-		if(opcode == 0x08)		//addi
-		{
-			if(address >= 0x8000)
-			{
-				address = (address ^ 0xffff) + 1;
-				registers[rt] = registers[rs] - address;
-			}
-			else
-				registers[rt] = registers[rs] + address;
-			printf("instant + rs = rt\t %d + %x = %x\n", address, registers[rs], registers[rt]);
-			return 1;
-		}
-		else if(opcode == 0x0c)	//andi
-		{
-			registers[rt] = registers[rs] & address;
-			printf("instant & rs = rt\t %x & %x = %x\n", address, registers[rs], registers[rt]);
-			return 1;
-		}
-		else if(opcode == 0x0d)	//ori
-		{
-			registers[rt] = registers[rs] | address;
-			printf("instant ori rs = rt\t %x ori %x = %x\n", address, registers[rs], registers[rt]);
-			return 1;
-		}
-		else if(opcode == 0x23)	//lw
-		{
-			temp = registers[rs] + address;
-			registers[rt] = 0;
-			for(int i = 0; i < WORD_SIZE; i++)
-			{
-				registers[rt] = registers[rt] + (memory[temp + i] << (24 - 8 * i));
-			}
-			printf("load value = %x\n", registers[rt]);
-			return 1;
-		}
-		else if(opcode == 0x2b)	//sw
-		{
-			temp = registers[rs] + address;
-			for(int i = 0; i < WORD_SIZE; i++)
-			{
-				memory[temp + i] = registers[rt] / ( 1 << (24 - 8 * i));
-			}
+	mem_fini(&m->memory);
+	for(unsigned int i = 0; i < nr_pages; i++)
+	{
+		const unsigned char *page = checkpoint + CHECKPOINT_HEADER_SIZE + i * (4 + PAGE_SIZE);
 
-			printf("instant : %x memory value: %x   store value : %x\n", address, memory[temp], registers[rt]);
-			return 1;
-		}
-		else if(opcode == 0x0a)	//slti
+		if(mem_write_bytes(&m->memory, get_be32(page) & ~(PAGE_SIZE - 1), page + 4, PAGE_SIZE))
 		{
-			registers[rt] = (registers[rs] < address) ? 1 : 0;
-			printf("slti// rs = %x   instant value : %x   rt = %x", registers[rs], address, registers[rt]);
-			return 1;
+			fprintf(stderr, "Memory fault at 0x%08x\n", m->memory.fault_addr);
+			goto out;
 		}
-		else if(opcode == 0x04)	//beq
-		{
-			if(registers[rs] == registers[rt])
-			{
-				if(address >= 0x8000)	//음수라면
-				{
-					pc = pc - ((0xffff ^ address) + 1) * WORD_SIZE;
-				}
-				else
-				{
-					pc = pc + address * WORD_SIZE;
-				}
-				printf("beq실행\nrs : %x   rt : %x   pc : %x\n", registers[rs], registers[rt], pc);
-				return 1;
-			}
-			printf("beq 실행되지 않음\n");
+	}
 
-			return 1;
-		}
-		else if(opcode == 0x05)	//bne
-		{
-			if(registers[rs] != registers[rt])
-			{
-				if(address >= 0x8000)	//음수라면
-					pc = pc - ((0xffff ^ address) + 1) * WORD_SIZE;
-				else
-					pc = pc + address * WORD_SIZE;
-				printf("rs : %x   rt : %x   pc : %x\n", registers[rs], registers[rt], pc);
-				return 1;
-			}
-			printf("bne 실행되지않음");
-			return 1;
-		}
-		else
-			return 0;
+	for(int i = 0; i < 32; i++)
+	{
+		m->registers[i] = get_be32(checkpoint + 28 + i * 4);
 	}
+	m->pc = get_be32(checkpoint + 8);
+	m->entry_pc = get_be32(checkpoint + 12);
+	ret = decode_text(m, text_start, text_end) ? -1 : 0;
+	goto out;
 
-	return 0;
+invalid:
+	fprintf(stderr, "Invalid checkpoint %s\n", filename);
+out:
+	unmap_file(checkpoint, size);
+	return ret;
 }
 
-
 /**********************************************************************
- * load_program(filename)
+ * Batch execution
  *
  * DESCRIPTION
- *   Load the instructions in the file @filename onto the memory starting at
- *   @INITIAL_PC. Each line in the program file looks like;
- *
- *	 [MIPS instruction started with 0x prefix]  // optional comments
+ *   'batch' command runs all the programs listed in a manifest file, each on
+ *   its own machine, on a pool of threads. Each line of the manifest names a
+ *   program followed by the results expected after the program halts;
  *
- *   For example,
+ *     [program filename] [expectation] ...    // optional comments
  *
- *   0x8c090008
- *   0xac090020	// sw t1, zero + 32
- *   0x8c080000
+ *   where an expectation is one of
  *
- *   implies three MIPS instructions to load. Each machine instruction may
- *   be followed by comments like the second instruction. However you can simply
- *   call strtoimax(linebuffer, NULL, 0) to read the machine code while
- *   ignoring the comment parts.
+ *     [register name]=[value]   Value of a register. e.g., t0=0x7a314
+ *     pc=[value]                Value of the program counter
+ *     [[address]]=[value]       Word in the memory. e.g., [0x100]=0x7a314
  *
- *	 The program DOES NOT include the 'halt' instruction. Thus, make sure the
- *	 'halt' instruction is appended to the loaded instructions to terminate
- *	 your program properly.
+ *   The programs are loaded as 'load' command does, and run without any
+ *   tracing under the limits set by 'limit' command; a program stopped by
+ *   the limits fails. The results are reported in the order of the manifest with the
+ *   number of retired instructions of each program. The threads are only
+ *   available on POSIX systems (build with -pthread if needed); otherwise
+ *   the programs run one after another.
+ */
+#define MAX_EXPECTATIONS	32
+
+enum expectation_types {
+	EXPECT_REGISTER,
+	EXPECT_PC,
+	EXPECT_MEMORY,
+};
+
+struct expectation {
+	int type;			/* One of EXPECT_* above */
+	unsigned int where;	/* Register number or address */
+	unsigned int value;
+};
+
+struct batch_job {
+	char *filename;
+	int nr_expectations;
+	struct expectation expectations[MAX_EXPECTATIONS];
+
+	bool passed;
+	unsigned long long nr_retired;
+	char message[128];	/* Why the program failed */
+};
+
+struct batch {
+	struct batch_job *jobs;
+	int nr_jobs;
+	int next_job;		/* Next job to pick up */
+#ifndef _WIN32
+	pthread_mutex_t lock;
+#endif
+};
+
+static int __parse_command(char *command, int *nr_tokens, char *tokens[]);
+
+/**********************************************************************
+ * parse_expectation(token, e)
  *
- *	 Refer to the @main() for reading data from files. (fopen, fgets, fclose).
+ * DESCRIPTION
+ *   Parse the expectation @token of a manifest into @e.
  *
  * RETURN
- *	 0 on successfully load the program
- *	 any other value otherwise
+ *   0 on success, -1 if @token is malformed
  */
-
-static int load_program(char * const filename)
+static int parse_expectation(char *token, struct expectation *e)
 {
+	char *value = strchr(token, '=');
 
-	char buffer[200];
-	long long temp;
+	if(value == NULL)
+		return -1;
+	*value++ = '\0';
+	e->value = strtoimax(value, NULL, 0);
 
-	int num = 0;
-	FILE *input = stdin;
+	if(token[0] == '[')
+	{
+		e->type = EXPECT_MEMORY;
+		e->where = strtoimax(token + 1, NULL, 0);
+		return 0;
+	}
+	if(strmatch(token, "pc"))
+	{
+		e->type = EXPECT_PC;
+		return 0;
+	}
+	for(size_t i = 0; i < sizeof(register_names) / sizeof(*register_names); i++)
+	{
+		if(strmatch(token, register_names[i]))
+		{
+			e->type = EXPECT_REGISTER;
+			e->where = i;
+			return 0;
+		}
+	}
+	return -1;
+}
 
-	input = fopen(filename, "r");
+/**********************************************************************
+ * run_job(job)
+ *
+ * DESCRIPTION
+ *   Run the program of @job on a fresh machine and check the results.
+ */
+static void run_job(struct batch_job *job)
+{
+	struct machine *m = malloc(sizeof(*m));
 
-	if (input == NULL)
+	job->passed = false;
+	if(m == NULL)
 	{
-		fprintf(stderr, "No input file\n");
-		return EXIT_FAILURE;
+		snprintf(job->message, sizeof(job->message), "cannot allocate the machine");
+		return;
 	}
+	machine_init(m);
+	m->max_instructions = machine.max_instructions;
+	m->max_seconds = machine.max_seconds;
+	m->memory.max_pages = machine.memory.max_pages;
 
-	int index = INITIAL_PC;
-
-	while(fgets(buffer, sizeof(buffer), input) != NULL)
+	if(load_machine(m, job->filename))
 	{
-		temp = strtol(buffer, NULL, 16);
+		snprintf(job->message, sizeof(job->message), "cannot load the program");
+		goto out;
+	}
 
-		index = index + WORD_SIZE;
-		for(int i = 0; i < WORD_SIZE; i++)
-		{
-			index--;
-			memory[index] = temp % (1 << 8);
-			temp = temp / (1 << 8);
-		}
-		index = index + WORD_SIZE;
+	m->pc = m->entry_pc;
+	job->nr_retired = run_fast(m);
+
+	if(m->memory.faulted)
+	{
+		snprintf(job->message, sizeof(job->message), "memory fault at 0x%08x", m->memory.fault_addr);
+		goto out;
+	}
+	if(m->stopped != STOP_HALT)
+	{
+		snprintf(job->message, sizeof(job->message), "stopped at 0x%08x by the %s limit",
+				m->pc, m->stopped == STOP_LIMIT ? "instruction" : "time");
+		goto out;
 	}
 
-	temp = strtol(buffer, NULL, 16);
-	//문장 끝에 halt문이 없으면 추가.
-	if(temp != 0xffffffff)
+	for(int i = 0; i < job->nr_expectations; i++)
 	{
-		temp = 0xffffffff;
+		struct expectation *e = &job->expectations[i];
+		unsigned int actual;
 
-		index = index + WORD_SIZE;
-		for(int i = 0; i < WORD_SIZE; i++)
+		if(e->type == EXPECT_REGISTER)
+			actual = m->registers[e->where];
+		else if(e->type == EXPECT_PC)
+			actual = m->pc;
+		else
+			actual = mem_read_word(&m->memory, e->where);
+
+		if(actual != e->value)
 		{
-			index--;
-			memory[index] = temp % 256;
-			temp = temp / 256;
+			if(e->type == EXPECT_REGISTER)
+				snprintf(job->message, sizeof(job->message), "%s", register_names[e->where]);
+			else if(e->type == EXPECT_PC)
+				snprintf(job->message, sizeof(job->message), "pc");
+			else
+				snprintf(job->message, sizeof(job->message), "[0x%08x]", e->where);
+			snprintf(job->message + strlen(job->message), sizeof(job->message) - strlen(job->message),
+					" is 0x%08x, expected 0x%08x", actual, e->value);
+			goto out;
 		}
-		index = index + WORD_SIZE;
-	
 	}
-	if(input != stdin)
-		fclose(input);
+	job->passed = true;
 
-	return 0;
+out:
+	machine_fini(m);
+	free(m);
 }
 
+static void *batch_worker(void *arg)
+{
+	struct batch *batch = arg;
+
+	while(1)
+	{
+		int i;
+
+#ifndef _WIN32
+		pthread_mutex_lock(&batch->lock);
+#endif
+		i = batch->next_job++;
+#ifndef _WIN32
+		pthread_mutex_unlock(&batch->lock);
+#endif
+		if(i >= batch->nr_jobs)
+			break;
+
+		run_job(&batch->jobs[i]);
+	}
+	return NULL;
+}
 
 /**********************************************************************
- * run_program
+ * run_batch(manifest, nr_threads)
  *
  * DESCRIPTION
- *   Start running the program that is loaded by @load_program function above.
- *   If you implement @load_program() properly, the first instruction is placed
- *   at @INITIAL_PC. Using @pc, which is the program counter of this processor,
- *   you can emulate the MIPS processor by
- *
- *   1. Read instruction from @pc
- *   2. Increment @pc by 4
- *   3. Call @process_instruction(instruction)
- *   4. Repeat until @process_instruction() returns 0
+ *   Run the programs in @manifest with @nr_threads threads, and report the
+ *   results. @nr_threads <= 0 uses as many threads as the online CPUs.
  *
  * RETURN
- *   0
+ *   0 if all the programs have passed
+ *   any other value otherwise
  */
-static int run_program(void)
+static int run_batch(char * const manifest, int nr_threads)
 {
-	pc = INITIAL_PC;
+	struct batch batch = { .jobs = NULL, .nr_jobs = 0, .next_job = 0 };
+	char line[MAX_COMMAND];
+	int capacity = 0, nr_passed = 0;
+	unsigned long long nr_retired = 0;
+	struct timespec start;
+	double seconds;
+	FILE *input;
 
-	int num = 0;
-	int temp;
-	unsigned int instr;
+	input = fopen(manifest, "r");
+	if(input == NULL)
+	{
+		fprintf(stderr, "No input file\n");
+		return EXIT_FAILURE;
+	}
 
-	while(1)
+	while(fgets(line, sizeof(line), input))
 	{
-		//instr 초기화.
-		instr = 0;
+		char *tokens[MAX_NR_TOKENS] = { NULL };
+		int nr_tokens = 0;
+		struct batch_job *job;
 
-		//1. load
-		for(int i = 0; i < WORD_SIZE; i++)
+		__parse_command(line, &nr_tokens, tokens);
+		if(nr_tokens == 0)
+			continue;
+
+		if(batch.nr_jobs == capacity)
 		{
-			temp = memory[pc + i];
-			instr = instr + temp * (1 << 4*(6 - 2 * i));
+			struct batch_job *jobs;
+
+			capacity = capacity ? capacity * 2 : 64;
+			jobs = realloc(batch.jobs, sizeof(*jobs) * capacity);
+			if(jobs == NULL)
+			{
+				fprintf(stderr, "Cannot allocate the batch jobs\n");
+				goto out;
+			}
+			batch.jobs = jobs;
 		}
 
-		printf("load pc address : %0x\t\t", pc);
-		//2. increment @pc
-		pc += 0x4;
+		job = &batch.jobs[batch.nr_jobs++];
+		memset(job, 0x00, sizeof(*job));
+		job->filename = strdup(tokens[0]);
 
-		//3. call @proces and repeat.s
-		if(process_instruction(instr) == 0)
-			return 0;
+		for(int i = 1; i < nr_tokens && job->nr_expectations < MAX_EXPECTATIONS; i++)
+		{
+			if(parse_expectation(tokens[i], &job->expectations[job->nr_expectations]))
+			{
+				fprintf(stderr, "Wrong expectation %s for %s\n", tokens[i], job->filename);
+				continue;
+			}
+			job->nr_expectations++;
+		}
+	}
+
+	timespec_get(&start, TIME_UTC);
+#ifndef _WIN32
+	if(nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nr_threads > batch.nr_jobs)
+		nr_threads = batch.nr_jobs;
+	if(nr_threads < 1)
+		nr_threads = 1;
+
+	pthread_t *threads = malloc(sizeof(*threads) * nr_threads);
+
+	pthread_mutex_init(&batch.lock, NULL);
+	for(int i = 0; i < nr_threads; i++)
+	{
+		if(threads == NULL || pthread_create(&threads[i], NULL, batch_worker, &batch))
+		{
+			nr_threads = i;
+			break;
+		}
+	}
+	//thread가 하나도 안 만들어지면 직접 돌린다.
+	batch_worker(&batch);
+	for(int i = 0; i < nr_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&batch.lock);
+	free(threads);
+#else
+	batch_worker(&batch);
+#endif
+	seconds = elapsed_seconds(&start);
 
+	for(int i = 0; i < batch.nr_jobs; i++)
+	{
+		struct batch_job *job = &batch.jobs[i];
+
+		fprintf(stderr, "[%s] %s  %llu instructions%s%s\n", job->passed ? "PASS" : "FAIL",
+				job->filename, job->nr_retired, job->passed ? "" : "  ", job->message);
+		if(job->passed)
+			nr_passed++;
+		nr_retired += job->nr_retired;
 	}
+	fprintf(stderr, "%d passed, %d failed, %llu instructions in %.3f s\n",
+			nr_passed, batch.nr_jobs - nr_passed, nr_retired, seconds);
 
-	return 0;
+out:
+	fclose(input);
+	for(int i = 0; i < batch.nr_jobs; i++)
+	{
+		free(batch.jobs[i].filename);
+	}
+	free(batch.jobs);
+	return nr_passed == batch.nr_jobs ? 0 : EXIT_FAILURE;
 }
 
 
@@ -536,24 +4239,29 @@ static void __show_registers(char * const register_name)
 	}
 
 	for (int i = from; i < to; i++) {
-		fprintf(stderr, "[%02d:%2s] 0x%08x    %u\n", i, register_names[i], registers[i], registers[i]);
+		fprintf(stderr, "[%02d:%2s] 0x%08x    %u\n", i, register_names[i], machine.registers[i], machine.registers[i]);
 	}
 	if (include_pc) {
-		fprintf(stderr, "[  pc ] 0x%08x\n", pc);
+		fprintf(stderr, "[  pc ] 0x%08x\n", machine.pc);
 	}
 }
 
 static void __dump_memory(unsigned int addr, size_t length)
 {
     for (size_t i = 0; i < length; i += 4) {
+        unsigned char bytes[4];
+
+        for (int j = 0; j < 4; j++) {
+            bytes[j] = mem_read_byte(&machine.memory, addr + i + j);
+        }
         fprintf(stderr, "0x%08lx:  %02x %02x %02x %02x    %c %c %c %c\n",
 				addr + i,
-                memory[addr + i    ], memory[addr + i + 1],
-                memory[addr + i + 2], memory[addr + i + 3],
-                isprint(memory[addr + i    ]) ? memory[addr + i    ] : '.',
-				isprint(memory[addr + i + 1]) ? memory[addr + i + 1] : '.',
-				isprint(memory[addr + i + 2]) ? memory[addr + i + 2] : '.',
-				isprint(memory[addr + i + 3]) ? memory[addr + i + 3] : '.');
+                bytes[0], bytes[1],
+                bytes[2], bytes[3],
+                isprint(bytes[0]) ? bytes[0] : '.',
+				isprint(bytes[1]) ? bytes[1] : '.',
+				isprint(bytes[2]) ? bytes[2] : '.',
+				isprint(bytes[3]) ? bytes[3] : '.');
     }
 }
 
@@ -567,12 +4275,125 @@ static void __process_command(int argc, char *argv[])
 		} else {
 			printf("Usage: load [program filename]\n");
 		}
+	} else if (strmatch(argv[0], "convert")) {
+		if (argc == 3) {
+			convert_program(argv[1], argv[2]);
+		} else {
+			printf("Usage: convert [program filename] [image filename]\n");
+		}
+	} else if (strmatch(argv[0], "batch")) {
+		if (argc == 2 || argc == 3) {
+			run_batch(argv[1], argc == 3 ? strtoimax(argv[2], NULL, 0) : 0);
+		} else {
+			printf("Usage: batch [manifest filename] { [number of threads] }\n");
+		}
 	} else if (strmatch(argv[0], "run")) {
 		if (argc == 1) {
 			run_program();
 		} else {
 			printf("Usage: run\n");
 		}
+	} else if (strmatch(argv[0], "resume")) {
+		if (argc == 1) {
+			resume_program();
+		} else {
+			printf("Usage: resume\n");
+		}
+	} else if (strmatch(argv[0], "limit")) {
+		if (argc == 3 && strmatch(argv[1], "instructions")) {
+			machine.max_instructions = strtoull(argv[2], NULL, 0);
+		} else if (argc == 3 && strmatch(argv[1], "time")) {
+			machine.max_seconds = strtod(argv[2], NULL);
+		} else {
+			printf("Usage: limit { instructions [number of instructions] | time [seconds] }. 0 for no limit\n");
+		}
+	} else if (strmatch(argv[0], "checkpoint")) {
+		if (argc == 2) {
+			save_checkpoint(&machine, argv[1]);
+		} else {
+			printf("Usage: checkpoint [checkpoint filename]\n");
+		}
+	} else if (strmatch(argv[0], "restore")) {
+		if (argc == 2) {
+			restore_checkpoint(&machine, argv[1]);
+		} else {
+			printf("Usage: restore [checkpoint filename]\n");
+		}
+	} else if (strmatch(argv[0], "trace")) {
+		if (argc == 2 && strmatch(argv[1], "off")) {
+			trace_level = TRACE_OFF;
+		} else if (argc == 2 && strmatch(argv[1], "summary")) {
+			trace_level = TRACE_SUMMARY;
+		} else if (argc == 2 && strmatch(argv[1], "full")) {
+			trace_level = TRACE_FULL;
+		} else {
+			printf("Usage: trace { off | summary | full }\n");
+		}
+	} else if (strmatch(argv[0], "profile")) {
+		if (argc == 2 && strmatch(argv[1], "on")) {
+			if (!machine.profile)
+				machine.profile = calloc(1, sizeof(*machine.profile));
+		} else if (argc == 2 && strmatch(argv[1], "off")) {
+			profile_free(&machine);
+		} else if ((argc == 2 || argc == 3) && strmatch(argv[1], "report")) {
+			profile_report(&machine, argc == 3 ? strtoimax(argv[2], NULL, 0) : 10);
+		} else if (argc == 3 && strmatch(argv[1], "dump")) {
+			profile_dump(&machine, argv[2]);
+		} else {
+			printf("Usage: profile { on | off | report { [number of lines] } | dump [filename] }\n");
+		}
+	} else if (strmatch(argv[0], "pipeline")) {
+		if (argc >= 2 && strmatch(argv[1], "on")) {
+			setup_pipeline(&machine, argc, argv);
+		} else if (argc == 2 && strmatch(argv[1], "off")) {
+			free(machine.pipeline);
+			machine.pipeline = NULL;
+		} else if (argc == 2 && strmatch(argv[1], "stats")) {
+			pipeline_report(&machine);
+		} else {
+			printf("Usage: pipeline { on { -n } { -b id|ex } | off | stats }\n");
+		}
+	} else if (strmatch(argv[0], "predict")) {
+		if (argc >= 2 && strmatch(argv[1], "on")) {
+			setup_predictor(&machine, argc, argv);
+		} else if (argc == 2 && strmatch(argv[1], "off")) {
+			predictor_free(&machine);
+		} else if ((argc == 2 || argc == 3) && strmatch(argv[1], "report")) {
+			predictor_report(&machine, argc == 3 ? strtoimax(argv[2], NULL, 0) : 10);
+		} else {
+			printf("Usage: predict { on { taken | not-taken | bimodal | gshare | tournament } { -s [table bits] } { -b [BTB entries] } { -r [RAS entries] } | off | report { [number of lines] } }\n");
+		}
+	} else if (strmatch(argv[0], "ooo")) {
+		if (argc >= 2 && strmatch(argv[1], "on")) {
+			setup_ooo(&machine, argc, argv);
+		} else if (argc == 2 && strmatch(argv[1], "off")) {
+			ooo_free(&machine);
+		} else if (argc == 2 && strmatch(argv[1], "stats")) {
+			ooo_report(&machine);
+		} else {
+			printf("Usage: ooo { on { -w [width] } { -r [ROB entries] } { -s [RS entries] } { -u [alu:mem:branch units] } { -l [alu:mem:branch latencies] } | off | stats }\n");
+		}
+	} else if (strmatch(argv[0], "cache")) {
+#ifdef USE_CACHE_MODEL
+		if (argc >= 5 && strmatch(argv[1], "on")) {
+			setup_cache_model(argc, argv);
+		} else if (argc == 2 && strmatch(argv[1], "off")) {
+			cache_model = CACHE_MODEL_OFF;
+			fini_cache_model();
+		} else if (argc == 2 && strmatch(argv[1], "stats") && cache_model) {
+			report_cycles();
+		} else {
+			printf("Usage: cache { on { -f } { [options of pa3] } [words per block] [number of blocks] [number of ways] | off | stats }\n");
+		}
+#else
+		printf("The cache model is not built in. Build with -DUSE_CACHE_MODEL and link pa3.c\n");
+#endif
+	} else if (strmatch(argv[0], "memlimit")) {
+		if (argc == 2) {
+			machine.memory.max_pages = strtoimax(argv[1], NULL, 0) * ((1 << 20) / PAGE_SIZE);
+		} else {
+			printf("Usage: memlimit [max memory in MB. 0 for no limit]\n");
+		}
 	} else if (strmatch(argv[0], "show")) {
 		if (argc == 1) {
 			__show_registers("all");
@@ -636,6 +4457,8 @@ int main(int argc, char * const argv[])
 	char command[MAX_COMMAND] = {'\0'};
 	FILE *input = stdin;
 
+	machine_init(&machine);
+
 	if (argc > 1) {
 		input = fopen(argv[1], "r");
 		if (!input) {
@@ -18,6 +18,19 @@
 #include <string.h>
 #include <inttypes.h>
 #include <ctype.h>
+#include <time.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*====================================================================*/
 /*          ****** DO NOT MODIFY ANYTHING FROM THIS LINE ******       */
@@ -58,186 +71,3360 @@ static unsigned char memory[8 << 10] = {
 	0x80, 0x82, 0x84, 0x86, 0x88, 0x8a, 0x8c, 0x8e,
 };
 
-/* Cache block */
-struct cache_block {
-	bool valid;				/* Whether the block is valid or invalid.
-							   Use CB_INVALID or CB_VALID macro above  */
-	bool dirty;				/* Whether the block is updated or not.
-							   Use CB_CLEAN or CB_DIRTY defined above */
-	unsigned int tag;		/* Tag */
-	unsigned int timestamp;	/* Timestamp or clock cycles to implement LRU */
-	unsigned char data[BYTES_PER_WORD * MAX_NR_WORDS_PER_BLOCK];
-							/* Each block can hold multiple words */
+/* Kinds of the misses. See 'Miss classification' below */
+enum miss_kinds {
+	MISS_COMPULSORY = 0,
+	MISS_CAPACITY,
+	MISS_CONFLICT,
+	NR_MISS_KINDS,
+};
+
+/* Cache blocks. Rather than an array of blocks, each field of the blocks
+ * has its own array so that the tags of a set sit next to each other and
+ * can be compared at once. The block for way w of set s is at index
+ * (s * nr_ways + w) of every array. */
+struct cache {
+	const char *name;
+	int level;				/* 1 for L1, 2 for L2, ... */
+
+	/* Geometry. See @nr_words_per_block, @nr_blocks, @nr_ways, and @nr_sets */
+	int nr_words_per_block;
+	int nr_blocks;
+	int nr_ways;
+	int nr_sets;
+
+	/* Shifts and masks to split an address into the tag, the set index, and
+	 * the offset in the block */
+	unsigned int block_size;		//block 하나의 byte 수
+	unsigned int offset_mask;
+	unsigned int index_shift;		//offset bit 수
+	unsigned int index_mask;
+	unsigned int tag_shift;			//offset bit + index bit 수
+
+	int hit_cycles;			/* Clock cycles to access a block hit */
+	int inclusion;			/* One of INCLUSION_* of the cache hierarchy */
+	struct cache *next;		/* The next level. NULL if @memory */
+
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long writebacks;
+	unsigned long long back_invalidations;	/* Invalidated by an inclusive lower level */
+
+	unsigned int *tags;		/* Tag. INVALID_TAG if the block is invalid */
+	bool *valid;			/* Whether the block is valid or invalid.
+							   Use CB_INVALID or CB_VALID macro above  */
+	bool *dirty;			/* Whether the block is updated or not.
+							   Use CB_CLEAN or CB_DIRTY defined above */
+	unsigned long long *timestamps;	/* Clock cycles when the block is accessed last */
+	unsigned char *data;	/* @block_size bytes for each block */
+
+	/* Replacement policy and its states. See 'Replacement policies' below */
+	const struct replacement_policy *policy;
+	unsigned short *recency_prev;	/* Ways of each set in the recency order */
+	unsigned short *recency_next;
+	unsigned short *recency_head;	/* The most recent way of each set */
+	unsigned short *recency_tail;	/* The least recent way of each set */
+	unsigned char *plru;			/* Tree bits */
+	unsigned char *rrpv;			/* Re-reference prediction values */
+	unsigned int seed;				/* For the random numbers */
+
+	/* Prefetcher and its statistics. See 'Prefetchers' below */
+	const struct prefetcher *prefetcher;	/* NULL if not prefetching */
+	bool *prefetched;				/* Filled by a prefetch and not demanded yet */
+	unsigned long long *ready;		/* Clock cycles when the prefetch completes */
+	unsigned long long prefetches;
+	unsigned long long useful_prefetches;
+	unsigned long long late_prefetches;
+	unsigned long long useless_prefetches;
+	unsigned long long polluting_misses;	/* Misses on blocks evicted by prefetches */
+
+	/* Classification of the misses. See 'Miss classification' below */
+	bool classify;
+	struct shadow_cache *shadow;
+	unsigned long long misses_by_kind[NR_MISS_KINDS];
+	unsigned long long recovered[NR_MISS_KINDS];	/* Served by the victim cache */
+
+	/* Write policy, write buffer, and traffic. See 'Write policies' below */
+	bool write_through;
+	bool no_write_allocate;
+	bool timed_writes;				/* Whether the writes to the level below take time */
+	int nr_write_entries;			/* Depth of the write buffer. 0 if none */
+	unsigned int *write_blocks;		/* Address of the block in each entry */
+	unsigned int *write_words;		/* Bitmap of the words written in each entry */
+	unsigned long long *write_done;	/* When each entry is drained */
+	int write_head;					/* The oldest entry */
+	int write_count;
+	unsigned long long pending_stall;	/* Stalls not added to the access yet */
+	unsigned long long write_stalls;
+	unsigned long long bytes_read;		/* From the level below */
+	unsigned long long bytes_written;	/* To the level below */
+};
+
+/* Tags are at most 30 bits, so no address has this tag */
+#define INVALID_TAG	0xffffffff
+
+static struct cache cache;
+
+/* The size of cache block. The value is set during the initialization */
+static int nr_words_per_block = 4;
+
+/* Number of cache blocks. The value is set during the initialization */
+static int nr_blocks = 16;
+
+/* Number of ways for the cache. Note @nr_ways == 1 means the direct mapped
+ * cache and @nr_ways == nr_blocks implies the fully associative cache */
+static int nr_ways = 2;
+
+/* Number of @nr_ways-way sets in the cache. This value will be set according to
+ * @nr_blocks and @nr_ways values */
+static int nr_sets = 8;
+
+/* Clock cycles */
+const int cycles_hit = 1;
+const int cycles_miss = 100;
+
+/* Simulate the tags only, without keeping the contents of the blocks.
+ * The contents of the caches are NULL and @memory is never updated. Set by
+ * '-n' option, or when there are more than one level of caches */
+static bool dataless = false;
+
+/* Elapsed clock cycles so far */
+static unsigned long long cycles = 0;
+
+
+/**
+ * strmatch()
+ *
+ * DESCRIPTION
+ *   Compare strings @str and @expect and return 1 if they are the same.
+ *   You may use this function to simplify string matching :)
+ *
+ * RETURN
+ *   1 if @str and @expect are the same
+ *   0 otherwise
+ */
+static inline bool strmatch(char * const str, const char *expect)
+{
+    return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
+}
+
+/**
+ * log2_discrete
+ *
+ * DESCRIPTION
+ *   Return the integer part of log_2(@n). FREE TO USE IN YOUR IMPLEMENTATION.
+ *   Will be useful for calculating the length of tag for a given address.
+ */
+static int log2_discrete(int n)
+{
+	int result = -1;
+	do {
+		n = n >> 1;
+		result++;
+	} while (n);
+
+	return result;
+}
+/*          ****** DO NOT MODIFY ANYTHING UP TO THIS LINE ******      */
+/*====================================================================*/
+
+
+/**************************************************************************
+ * read_block(addr, data, block_size) / write_block(addr, data, block_size)
+ *
+ * DESCRIPTION
+ *   Copy the block of @block_size bytes starting at @addr between @memory
+ *   and @data. The traces
+ *   may access any 32-bit address while @memory only covers the first 8 KB,
+ *   so the bytes beyond @memory are read as zeroes and the writes to them
+ *   are dropped.
+ */
+static void read_block(unsigned int addr, unsigned char *data, unsigned int block_size)
+{
+	unsigned int length = 0;
+
+	if(addr < sizeof(memory))
+	{
+		length = sizeof(memory) - addr < block_size ? sizeof(memory) - addr : block_size;
+		memcpy(data, &memory[addr], length);
+	}
+	memset(data + length, 0x00, block_size - length);
+}
+
+static void write_block(unsigned int addr, const unsigned char *data, unsigned int block_size)
+{
+	if(addr < sizeof(memory))
+		memcpy(&memory[addr], data, sizeof(memory) - addr < block_size ? sizeof(memory) - addr : block_size);
+}
+
+/**************************************************************************
+ * Replacement policies
+ *
+ * DESCRIPTION
+ *   Which block of a full set is replaced on a miss is decided by the
+ *   replacement policy of the cache, which is selected with '-r' option.
+ *   A policy is notified of every hit and fill, and picks the victim way
+ *   when the set has no invalid block. The policies are
+ *
+ *   lru    : Least recently used. The ways of each set are kept in a list
+ *            in the recency order, so both updating and picking are O(1)
+ *   plru   : Tree pseudo-LRU. Each set has (nr_ways - 1) bits forming a
+ *            binary tree, each of which points to the less recently used
+ *            half. @nr_ways should be a power of two
+ *   fifo   : First in, first out. The list of lru updated on fills only
+ *   random : A way picked at random
+ *   srrip  : Static re-reference interval prediction with 2-bit RRPVs.
+ *            Blocks are inserted with a long re-reference interval
+ *   brrip  : Bimodal RRIP. Blocks are inserted with a distant interval
+ *            except once in BRRIP_EPSILON fills
+ */
+#define RRPV_MAX		3
+#define BRRIP_EPSILON	32
+
+struct replacement_policy {
+	const char *name;
+	int (*init)(struct cache *c);
+	void (*hit)(struct cache *c, unsigned int set, unsigned int way);
+	void (*fill)(struct cache *c, unsigned int set, unsigned int way);
+	unsigned int (*victim)(struct cache *c, unsigned int set);
+};
+
+static inline unsigned int next_random(struct cache *c)
+{
+	//xorshift32
+	c->seed ^= c->seed << 13;
+	c->seed ^= c->seed >> 17;
+	c->seed ^= c->seed << 5;
+	return c->seed;
+}
+
+/* Move @way to the front (the most recent end) of the list of @set */
+static void move_to_front(struct cache *c, unsigned int set, unsigned int way)
+{
+	unsigned int first = set * c->nr_ways;
+	unsigned short prev, next;
+
+	if(c->recency_head[set] == way)
+		return;
+
+	//list에서 떼어낸다
+	prev = c->recency_prev[first + way];
+	next = c->recency_next[first + way];
+	c->recency_next[first + prev] = next;
+	if(c->recency_tail[set] == way)
+		c->recency_tail[set] = prev;
+	else
+		c->recency_prev[first + next] = prev;
+
+	//맨 앞에 붙인다
+	c->recency_next[first + way] = c->recency_head[set];
+	c->recency_prev[first + c->recency_head[set]] = way;
+	c->recency_head[set] = way;
+}
+
+static int init_recency(struct cache *c)
+{
+	c->recency_prev = malloc(sizeof(*c->recency_prev) * c->nr_blocks);
+	c->recency_next = malloc(sizeof(*c->recency_next) * c->nr_blocks);
+	c->recency_head = calloc(c->nr_sets, sizeof(*c->recency_head));
+	c->recency_tail = malloc(sizeof(*c->recency_tail) * c->nr_sets);
+	if(!c->recency_prev || !c->recency_next || !c->recency_head || !c->recency_tail)
+		return -1;
+
+	for(int set = 0; set < c->nr_sets; set++)
+	{
+		for(int way = 0; way < c->nr_ways; way++)
+		{
+			c->recency_prev[set * c->nr_ways + way] = way - 1;
+			c->recency_next[set * c->nr_ways + way] = way + 1;
+		}
+		c->recency_tail[set] = c->nr_ways - 1;
+	}
+	return 0;
+}
+
+static unsigned int victim_recency(struct cache *c, unsigned int set)
+{
+	return c->recency_tail[set];
+}
+
+static void touch_recency(struct cache *c, unsigned int set, unsigned int way)
+{
+	move_to_front(c, set, way);
+}
+
+static void ignore_access(struct cache *c, unsigned int set, unsigned int way)
+{
+	(void)c;
+	(void)set;
+	(void)way;
+}
+
+/* Bit @node of the tree of @set. The root is node 1 */
+#define PLRU_BIT(c, set, node)	((set) * (c)->nr_ways + (node))
+
+static int init_plru(struct cache *c)
+{
+	c->plru = calloc((c->nr_blocks + 7) / 8, 1);
+	return c->plru ? 0 : -1;
+}
+
+static void touch_plru(struct cache *c, unsigned int set, unsigned int way)
+{
+	unsigned int node = 1;
+
+	//root부터 내려가면서 각 node가 @way의 반대쪽을 가리키게 한다
+	for(unsigned int half = c->nr_ways / 2; half > 0; half /= 2)
+	{
+		unsigned int bit = PLRU_BIT(c, set, node);
+		bool right = (way & half) != 0;
+
+		if(right)
+			c->plru[bit / 8] &= ~(1 << (bit % 8));
+		else
+			c->plru[bit / 8] |= 1 << (bit % 8);
+		node = node * 2 + right;
+	}
+}
+
+static unsigned int victim_plru(struct cache *c, unsigned int set)
+{
+	unsigned int node = 1;
+
+	while(node < (unsigned int)c->nr_ways)
+	{
+		unsigned int bit = PLRU_BIT(c, set, node);
+
+		node = node * 2 + ((c->plru[bit / 8] >> (bit % 8)) & 1);
+	}
+	return node - c->nr_ways;
+}
+
+static int init_random(struct cache *c)
+{
+	c->seed = 0x2545f491;
+	return 0;
+}
+
+static unsigned int victim_random(struct cache *c, unsigned int set)
+{
+	(void)set;
+	return next_random(c) % c->nr_ways;
+}
+
+static int init_rrip(struct cache *c)
+{
+	c->seed = 0x2545f491;
+	c->rrpv = malloc(c->nr_blocks);
+	if(c->rrpv == NULL)
+		return -1;
+	memset(c->rrpv, RRPV_MAX, c->nr_blocks);
+	return 0;
+}
+
+static void hit_rrip(struct cache *c, unsigned int set, unsigned int way)
+{
+	c->rrpv[set * c->nr_ways + way] = 0;
+}
+
+static void fill_srrip(struct cache *c, unsigned int set, unsigned int way)
+{
+	c->rrpv[set * c->nr_ways + way] = RRPV_MAX - 1;
+}
+
+static void fill_brrip(struct cache *c, unsigned int set, unsigned int way)
+{
+	c->rrpv[set * c->nr_ways + way] = next_random(c) % BRRIP_EPSILON ? RRPV_MAX : RRPV_MAX - 1;
+}
+
+static unsigned int victim_rrip(struct cache *c, unsigned int set)
+{
+	unsigned char *rrpv = &c->rrpv[set * c->nr_ways];
+
+	//RRPV_MAX인 block이 나올 때까지 모두 나이를 먹인다
+	while(true)
+	{
+		for(int way = 0; way < c->nr_ways; way++)
+		{
+			if(rrpv[way] == RRPV_MAX)
+				return way;
+		}
+		for(int way = 0; way < c->nr_ways; way++)
+		{
+			rrpv[way]++;
+		}
+	}
+}
+
+static const struct replacement_policy policies[] = {
+	{ "lru", init_recency, touch_recency, touch_recency, victim_recency },
+	{ "plru", init_plru, touch_plru, touch_plru, victim_plru },
+	{ "fifo", init_recency, ignore_access, touch_recency, victim_recency },
+	{ "random", init_random, ignore_access, ignore_access, victim_random },
+	{ "srrip", init_rrip, hit_rrip, fill_srrip, victim_rrip },
+	{ "brrip", init_rrip, hit_rrip, fill_brrip, victim_rrip },
+};
+
+static const struct replacement_policy *find_policy(const char *name)
+{
+	for(size_t i = 0; i < sizeof(policies) / sizeof(*policies); i++)
+	{
+		if(strmatch((char *)name, policies[i].name))
+			return &policies[i];
+	}
+	return NULL;
+}
+
+static void free_policy(struct cache *c)
+{
+	free(c->recency_prev);
+	free(c->recency_next);
+	free(c->recency_head);
+	free(c->recency_tail);
+	free(c->plru);
+	free(c->rrpv);
+}
+
+
+/**************************************************************************
+ * find_way(tags, nr_ways, tag)
+ *
+ * DESCRIPTION
+ *   Find @tag among the @nr_ways tags of a set starting at @tags. With SSE2,
+ *   four tags are compared by an instruction.
+ *
+ * RETURN
+ *   The way holding @tag, -1 if there is no such way
+ */
+static inline int find_way(const unsigned int *tags, int nr_ways, unsigned int tag)
+{
+	int i = 0;
+
+#ifdef __SSE2__
+	__m128i key = _mm_set1_epi32(tag);
+
+	for(; i + 4 <= nr_ways; i += 4)
+	{
+		__m128i ways = _mm_loadu_si128((const __m128i *)(tags + i));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ways, key)));
+
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for(; i < nr_ways; i++)
+	{
+		if(tags[i] == tag)
+			return i;
+	}
+	return -1;
+}
+
+
+/**************************************************************************
+ * Miss classification
+ *
+ * DESCRIPTION
+ *   With '-c' option, the misses of @cache are classified into the three
+ *   Cs. Next to @cache, a shadow fully-associative LRU cache of the same
+ *   number of blocks and the set of all the blocks ever accessed are kept.
+ *   A miss is
+ *
+ *   MISS_COMPULSORY : if the block has never been accessed before
+ *   MISS_CAPACITY   : if the shadow cache misses as well
+ *   MISS_CONFLICT   : if the shadow cache hits, i.e., the block would have
+ *                     been there without the set conflicts
+ *
+ *   The shadow cache is a list of the blocks in the recency order with a
+ *   hash table on it, and the set of the blocks is a hash table growing as
+ *   needed, so both take O(1) per access.
+ */
+static const char * const miss_kind_names[NR_MISS_KINDS] = {
+	[MISS_COMPULSORY] = "compulsory",
+	[MISS_CAPACITY] = "capacity",
+	[MISS_CONFLICT] = "conflict",
+};
+
+struct shadow_cache {
+	unsigned int nr_slots;			/* Blocks of the cache being classified */
+	unsigned int nr_used;
+	unsigned int *blocks;			/* Block number in each slot */
+	int *prev, *next;				/* Slots in the recency order */
+	int head, tail;					/* The most and the least recent slots */
+	int *buckets;					/* First slot of each hash bucket. -1 if none */
+	int *chain;						/* Next slot in the same bucket */
+	unsigned int bucket_mask;
+
+	/* All the blocks ever accessed, stored as (block number + 1). 0 if empty */
+	unsigned int *seen;
+	size_t seen_mask;
+	size_t nr_seen;
+};
+
+/* Whether to classify the misses of @cache. Set by '-c' option */
+static bool classify_misses = false;
+
+static inline unsigned int hash_block(unsigned int block)
+{
+	return block * 0x9e3779b1;
+}
+
+static int init_shadow(struct cache *c)
+{
+	struct shadow_cache *s = calloc(1, sizeof(*s));
+	unsigned int nr_buckets = 1;
+
+	c->shadow = s;
+	if(s == NULL)
+		return -1;
+	while(nr_buckets < 2 * (unsigned int)c->nr_blocks)
+		nr_buckets <<= 1;
+
+	s->nr_slots = c->nr_blocks;
+	s->blocks = malloc(sizeof(*s->blocks) * s->nr_slots);
+	s->prev = malloc(sizeof(*s->prev) * s->nr_slots);
+	s->next = malloc(sizeof(*s->next) * s->nr_slots);
+	s->chain = malloc(sizeof(*s->chain) * s->nr_slots);
+	s->buckets = malloc(sizeof(*s->buckets) * nr_buckets);
+	s->bucket_mask = nr_buckets - 1;
+	s->seen_mask = 1023;
+	s->seen = calloc(s->seen_mask + 1, sizeof(*s->seen));
+	if(!s->blocks || !s->prev || !s->next || !s->chain || !s->buckets || !s->seen)
+		return -1;
+
+	memset(s->buckets, 0xff, sizeof(*s->buckets) * nr_buckets);
+	s->head = s->tail = -1;
+	return 0;
+}
+
+static void free_shadow(struct cache *c)
+{
+	struct shadow_cache *s = c->shadow;
+
+	if(s == NULL)
+		return;
+	free(s->blocks);
+	free(s->prev);
+	free(s->next);
+	free(s->chain);
+	free(s->buckets);
+	free(s->seen);
+	free(s);
+	c->shadow = NULL;
+}
+
+/* Add @block to the set of the blocks. true if it has been there */
+static bool mark_seen(struct shadow_cache *s, unsigned int block)
+{
+	size_t i;
+
+	for(i = hash_block(block) & s->seen_mask; s->seen[i]; i = (i + 1) & s->seen_mask)
+	{
+		if(s->seen[i] == block + 1)
+			return true;
+	}
+	s->seen[i] = block + 1;
+
+	//반 이상 차면 두 배로 늘려서 다시 넣는다
+	if(++s->nr_seen * 2 > s->seen_mask)
+	{
+		size_t mask = s->seen_mask * 2 + 1;
+		unsigned int *seen = calloc(mask + 1, sizeof(*seen));
+
+		if(seen == NULL)
+			return false;
+		for(size_t j = 0; j <= s->seen_mask; j++)
+		{
+			if(s->seen[j] == 0)
+				continue;
+			for(i = hash_block(s->seen[j] - 1) & mask; seen[i]; i = (i + 1) & mask)
+				;
+			seen[i] = s->seen[j];
+		}
+		free(s->seen);
+		s->seen = seen;
+		s->seen_mask = mask;
+	}
+	return false;
+}
+
+static void unlink_slot(struct shadow_cache *s, int slot)
+{
+	if(s->prev[slot] >= 0)
+		s->next[s->prev[slot]] = s->next[slot];
+	else
+		s->head = s->next[slot];
+	if(s->next[slot] >= 0)
+		s->prev[s->next[slot]] = s->prev[slot];
+	else
+		s->tail = s->prev[slot];
+}
+
+static void push_slot(struct shadow_cache *s, int slot)
+{
+	s->prev[slot] = -1;
+	s->next[slot] = s->head;
+	if(s->head >= 0)
+		s->prev[s->head] = slot;
+	else
+		s->tail = slot;
+	s->head = slot;
+}
+
+/**************************************************************************
+ * classify_access(c, addr)
+ *
+ * DESCRIPTION
+ *   Access @addr through the shadow cache and the set of the blocks of @c.
+ *
+ * RETURN
+ *   The kind of the miss if @c misses @addr. One of MISS_*
+ */
+static int classify_access(struct cache *c, unsigned int addr)
+{
+	struct shadow_cache *s = c->shadow;
+	unsigned int block = addr >> c->index_shift;
+	int *bucket = &s->buckets[hash_block(block) & s->bucket_mask];
+	int slot;
+
+	for(slot = *bucket; slot >= 0; slot = s->chain[slot])
+	{
+		if(s->blocks[slot] == block)
+		{
+			unlink_slot(s, slot);
+			push_slot(s, slot);
+			return MISS_CONFLICT;
+		}
+	}
+
+	//shadow cache가 꽉 찼으면 LRU slot을 hash table에서 빼고 재사용한다
+	if(s->nr_used < s->nr_slots)
+		slot = s->nr_used++;
+	else
+	{
+		int *link;
+
+		slot = s->tail;
+		unlink_slot(s, slot);
+		link = &s->buckets[hash_block(s->blocks[slot]) & s->bucket_mask];
+		while(*link != slot)
+			link = &s->chain[*link];
+		*link = s->chain[slot];
+	}
+	s->blocks[slot] = block;
+	s->chain[slot] = *bucket;
+	*bucket = slot;
+	push_slot(s, slot);
+
+	return mark_seen(s, block) ? MISS_CAPACITY : MISS_COMPULSORY;
+}
+
+
+/**************************************************************************
+ * Cache hierarchy
+ *
+ * DESCRIPTION
+ *   The cache configured by the input, @cache, is the L1 data cache. The
+ *   lower levels given by '-l' options are placed below it in the order,
+ *   and an L1 instruction cache can be placed beside it by '-i' option.
+ *   Instruction fetches go to @cache as well if there is no '-i'.
+ *
+ *   An access is served by the first level having the block, and takes
+ *   @hit_cycles of that level, or @memory_cycles if no level has it. The
+ *   levels missed on the way are filled with the block. How a lower level
+ *   holds the blocks of the levels above depends on its @inclusion;
+ *
+ *   INCLUSION_NINE      : Neither inclusive nor exclusive. Filled on misses
+ *                         and replaces its blocks on its own
+ *   INCLUSION_INCLUSIVE : Like NINE, but evicting a block also invalidates
+ *                         its copies in the levels above
+ *   INCLUSION_EXCLUSIVE : Only holds the blocks evicted from the level
+ *                         above. A block hit is moved up to the level above.
+ *                         Must have the block size of the level above
+ *
+ *   Dirty victims are written back to the next level, allocating the block
+ *   there if missing, and to @memory from the last level. With more than one
+ *   level the blocks are simulated without their contents (see @dataless).
+ *
+ *   '-v' option puts a small fully-associative victim cache, @victim_cache,
+ *   right below @cache. It is an exclusive level holding the blocks evicted
+ *   from @cache only, so a miss of @cache hitting there takes the block back
+ *   instead of going down.
+ */
+#define MAX_LEVELS	8
+
+enum inclusion_policies {
+	INCLUSION_NINE = 0,
+	INCLUSION_INCLUSIVE,
+	INCLUSION_EXCLUSIVE,
+};
+
+static const char * const inclusion_names[] = {
+	[INCLUSION_NINE] = "nine",
+	[INCLUSION_INCLUSIVE] = "inclusive",
+	[INCLUSION_EXCLUSIVE] = "exclusive",
+};
+
+/* L1 instruction cache. Used if @icache.nr_blocks > 0 */
+static struct cache icache;
+
+/* L2, L3, ... given by '-l' options */
+static struct cache lower_levels[MAX_LEVELS - 2];
+static int nr_lower_levels = 0;
+
+/* Victim cache of @cache. Used if @nr_victims > 0 */
+static struct cache victim_cache;
+static int nr_victims = 0;
+
+/* All the caches from the upper levels, @cache first */
+static struct cache *levels[MAX_LEVELS];
+static int nr_levels = 0;
+
+/* Clock cycles to access @memory. cycles_miss if not given by '-m' option */
+static int memory_cycles = 0;
+
+/* Replacement policy of the caches. Set by '-r' option */
+static const struct replacement_policy *policy = NULL;
+
+static inline unsigned int block_address(struct cache *c, unsigned int block)
+{
+	return (c->tags[block] << c->tag_shift) | ((block / c->nr_ways) << c->index_shift);
+}
+
+/* Index of the block containing @addr in @c. -1 if @c does not have it */
+static inline int find_block(struct cache *c, unsigned int addr)
+{
+	unsigned int first = ((addr >> c->index_shift) & c->index_mask) * c->nr_ways;
+	int way = find_way(&c->tags[first], c->nr_ways, addr >> c->tag_shift);
+
+	return way < 0 ? -1 : (int)(first + way);
+}
+
+static inline void invalidate_block(struct cache *c, unsigned int block)
+{
+	c->valid[block] = CB_INVALID;
+	c->dirty[block] = CB_CLEAN;
+	c->tags[block] = INVALID_TAG;
+	if(c->prefetched)
+		c->prefetched[block] = false;
+}
+
+static unsigned int fill_block(struct cache *c, unsigned int addr, bool dirty);
+
+/**************************************************************************
+ * Write policies
+ *
+ * DESCRIPTION
+ *   By default @cache is write-back and write-allocate, and writing to the
+ *   level below takes no time. '-w' option changes how @cache handles the
+ *   stores and makes the writes to the level below take time;
+ *
+ *     -w [back | through] { :[allocate | no-allocate] { :[buffer depth] } }
+ *
+ *   back        : A store hit only marks the block dirty. Dirty victims are
+ *                 written to the level below
+ *   through     : A store hit is written to the level below as well, and
+ *                 the blocks are never dirty
+ *   allocate    : A store miss fills the block like a load miss
+ *   no-allocate : A store miss is written to the level below without filling
+ *
+ *   The writes to the level below go through a coalescing write buffer of
+ *   @nr_write_entries blocks (4 by default). A write to a block in the
+ *   buffer is merged into it, and each entry drains in turn, taking as long
+ *   as a hit of the level below (or @memory_cycles). The processor stalls
+ *   only when the buffer is full, or on every write if the depth is 0. The
+ *   buffer holds the addresses only; the level below is updated at once.
+ *
+ *   Every level counts the bytes it reads from and writes to the level
+ *   below. Those of the last level are the traffic to @memory. A victim
+ *   moved into an exclusive level counts as written even if clean, and an
+ *   exclusive level counts the blocks it passes up from below as read.
+ */
+#define DEFAULT_WRITE_BUFFER_DEPTH	4
+
+/* Write policy of @cache. Set by '-w' option */
+static bool timed_writes = false;
+static bool write_through = false;
+static bool no_write_allocate = false;
+static int write_buffer_depth = DEFAULT_WRITE_BUFFER_DEPTH;
+
+/* Bitmap of all the words in a block of @c */
+static inline unsigned int block_words(struct cache *c)
+{
+	return c->nr_words_per_block >= 32 ? 0xffffffff : (1u << c->nr_words_per_block) - 1;
+}
+
+static inline int count_words(unsigned int words)
+{
+	int n = 0;
+
+	for(; words; words &= words - 1)
+		n++;
+	return n;
+}
+
+static int parse_write_policy(const char *spec)
+{
+	char hit[16] = "", miss[16] = "allocate";
+	int depth = DEFAULT_WRITE_BUFFER_DEPTH;
+
+	if(sscanf(spec, "%15[^:]:%15[^:]:%d", hit, miss, &depth) < 1 || depth < 0)
+		return -1;
+	if(!strmatch(hit, "back") && !strmatch(hit, "through"))
+		return -1;
+	if(!strmatch(miss, "allocate") && !strmatch(miss, "no-allocate"))
+		return -1;
+
+	timed_writes = true;
+	write_through = strmatch(hit, "through");
+	no_write_allocate = strmatch(miss, "no-allocate");
+	write_buffer_depth = depth;
+	return 0;
+}
+
+/**************************************************************************
+ * post_write(c, addr, words)
+ *
+ * DESCRIPTION
+ *   Account writing @words (bitmap of the words in the block) of the block
+ *   containing @addr from @c to the level below, and queue the write in the
+ *   write buffer of @c if the writes take time. The cycles stalled for the
+ *   write are added to @pending_stall of @c.
+ */
+static void post_write(struct cache *c, unsigned int addr, unsigned int words)
+{
+	unsigned int block = addr & ~c->offset_mask;
+	unsigned long long now = cycles + c->pending_stall;
+	unsigned long long start;
+	unsigned int drain_cycles = c->next ? c->next->hit_cycles : memory_cycles;
+	int tail;
+
+	if(!c->timed_writes)
+	{
+		c->bytes_written += count_words(words) * BYTES_PER_WORD;
+		return;
+	}
+	if(c->nr_write_entries == 0)
+	{
+		c->bytes_written += count_words(words) * BYTES_PER_WORD;
+		c->pending_stall += drain_cycles;
+		return;
+	}
+
+	//다 빠져나간 entry는 버린다
+	while(c->write_count > 0 && c->write_done[c->write_head] <= now)
+	{
+		c->write_head = (c->write_head + 1) % c->nr_write_entries;
+		c->write_count--;
+	}
+
+	//같은 block이 buffer에 있으면 합친다
+	for(int i = 0; i < c->write_count; i++)
+	{
+		int e = (c->write_head + i) % c->nr_write_entries;
+
+		if(c->write_blocks[e] == block)
+		{
+			c->bytes_written += count_words(words & ~c->write_words[e]) * BYTES_PER_WORD;
+			c->write_words[e] |= words;
+			return;
+		}
+	}
+
+	//buffer가 꽉 찼으면 가장 오래된 entry가 빠질 때까지 멈춘다
+	if(c->write_count == c->nr_write_entries)
+	{
+		c->pending_stall += c->write_done[c->write_head] - now;
+		now = c->write_done[c->write_head];
+		c->write_head = (c->write_head + 1) % c->nr_write_entries;
+		c->write_count--;
+	}
+
+	start = now;
+	if(c->write_count > 0)
+	{
+		int last = (c->write_head + c->write_count - 1) % c->nr_write_entries;
+
+		if(c->write_done[last] > start)
+			start = c->write_done[last];
+	}
+	tail = (c->write_head + c->write_count) % c->nr_write_entries;
+	c->write_blocks[tail] = block;
+	c->write_words[tail] = words;
+	c->write_done[tail] = start + drain_cycles;
+	c->write_count++;
+	c->bytes_written += count_words(words) * BYTES_PER_WORD;
+}
+
+/**************************************************************************
+ * write_next(c, addr)
+ *
+ * DESCRIPTION
+ *   Write the word at @addr from @c through to the level below, which is
+ *   updated at once. An exclusive level is passed by unless it has the block.
+ */
+static void write_next(struct cache *c, unsigned int addr)
+{
+	post_write(c, addr, 1u << ((addr & c->offset_mask) / BYTES_PER_WORD));
+
+	for(struct cache *n = c->next; n; n = n->next)
+	{
+		int b = find_block(n, addr);
+
+		if(b >= 0)
+		{
+			n->dirty[b] = CB_DIRTY;
+			return;
+		}
+		if(n->inclusion != INCLUSION_EXCLUSIVE)
+		{
+			fill_block(n, addr, true);
+			return;
+		}
+	}
+}
+
+/* Stalls caused by the writes of @c during the access. Cleared once taken */
+static inline unsigned int take_write_stall(struct cache *c)
+{
+	unsigned int stall = c->pending_stall;
+
+	c->write_stalls += stall;
+	c->pending_stall = 0;
+	return stall;
+}
+
+
+/**************************************************************************
+ * evict_block(c, block)
+ *
+ * DESCRIPTION
+ *   Evict @block from @c. The block is written back if dirty, and is moved
+ *   to the next level if the next level is exclusive.
+ */
+static void evict_block(struct cache *c, unsigned int block)
+{
+	unsigned int addr = block_address(c, block);
+	bool dirty = c->dirty[block];
+
+	if(c->prefetched && c->prefetched[block])
+		c->useless_prefetches++;
+
+	//inclusive면 위 level에 있는 같은 block도 지운다. 위쪽이 dirty였으면 같이 내려보낸다.
+	if(c->inclusion == INCLUSION_INCLUSIVE)
+	{
+		for(int i = 0; i < nr_levels && levels[i]->level < c->level; i++)
+		{
+			struct cache *upper = levels[i];
+
+			for(unsigned int a = addr; a - addr < c->block_size; a += upper->block_size)
+			{
+				int b = find_block(upper, a);
+
+				if(b < 0)
+					continue;
+				dirty |= upper->dirty[b];
+				invalidate_block(upper, b);
+				upper->back_invalidations++;
+			}
+		}
+	}
+
+	if(dirty)
+	{
+		c->writebacks++;
+		if(c->next == NULL || c->next->inclusion != INCLUSION_EXCLUSIVE)
+			post_write(c, addr, block_words(c));
+
+		if(c->next == NULL)
+		{
+			if(c->data)
+				write_block(addr, &c->data[block * c->block_size], c->block_size);
+		}
+		else if(c->next->inclusion != INCLUSION_EXCLUSIVE)
+		{
+			//write-back. 아래 level에 없으면 새로 채운다.
+			int b = find_block(c->next, addr);
+
+			if(b >= 0)
+				c->next->dirty[b] = CB_DIRTY;
+			else
+				fill_block(c->next, addr, true);
+		}
+	}
+	//exclusive한 아래 level은 위에서 쫓겨난 block으로만 채워진다. clean이어도 옮겨 쓴다.
+	if(c->next && c->next->inclusion == INCLUSION_EXCLUSIVE)
+	{
+		c->bytes_written += c->block_size;
+		fill_block(c->next, addr, dirty);
+	}
+
+	invalidate_block(c, block);
+}
+
+/**************************************************************************
+ * fill_block(c, addr, dirty)
+ *
+ * DESCRIPTION
+ *   Put the block containing @addr into @c, in the invalid block of the set
+ *   or in place of the victim chosen by the replacement policy.
+ *
+ * RETURN
+ *   The index of the block filled
+ */
+static unsigned int fill_block(struct cache *c, unsigned int addr, bool dirty)
+{
+	unsigned int set = (addr >> c->index_shift) & c->index_mask;
+	unsigned int first = set * c->nr_ways;
+	int way = find_way(&c->tags[first], c->nr_ways, INVALID_TAG);
+	unsigned int block;
+
+	//비어있는 block이 있으면 그것부터 쓰고, 없으면 policy가 고른 block을 쓴다.
+	if(way < 0)
+	{
+		way = c->policy->victim(c, set);
+		evict_block(c, first + way);
+	}
+	block = first + way;
+
+	if(c->data)
+		read_block(addr & ~c->offset_mask, &c->data[block * c->block_size], c->block_size);
+	c->valid[block] = CB_VALID;
+	c->dirty[block] = dirty;
+	c->tags[block] = addr >> c->tag_shift;
+	c->timestamps[block] = cycles;
+	c->policy->fill(c, set, way);
+	return block;
+}
+
+static int access_level(struct cache *c, unsigned int addr, bool write, unsigned int *block, unsigned int *latency);
+
+/**************************************************************************
+ * fetch_block(c, addr, dirty, latency)
+ *
+ * DESCRIPTION
+ *   Bring the block containing @addr from @c for the level above, and add
+ *   the time taken to @latency. @c is @memory if NULL. If @c is exclusive,
+ *   the block leaves @c and @dirty is set if the block was dirty in @c.
+ */
+static void fetch_block(struct cache *c, unsigned int addr, bool *dirty, unsigned int *latency)
+{
+	unsigned int block;
+	int b;
+
+	if(c == NULL)
+	{
+		*latency += memory_cycles;
+		return;
+	}
+	if(c->inclusion != INCLUSION_EXCLUSIVE)
+	{
+		access_level(c, addr, false, &block, latency);
+		return;
+	}
+
+	//exclusive. 있으면 위로 올려보내고, 없으면 여기에는 채우지 않는다.
+	b = find_block(c, addr);
+	if(b >= 0)
+	{
+		c->hits++;
+		*dirty |= c->dirty[b];
+		invalidate_block(c, b);
+		*latency += c->hit_cycles;
+		return;
+	}
+	c->misses++;
+	c->bytes_read += c->block_size;
+	fetch_block(c->next, addr, dirty, latency);
+}
+
+/**************************************************************************
+ * access_level(c, addr, write, block, latency)
+ *
+ * DESCRIPTION
+ *   Access @addr through @c, filling @c and the levels below on misses.
+ *   The index of the block in @c is stored into @block (INVALID_TAG if a
+ *   store miss is not allocated), and the time taken is added to @latency.
+ *
+ * RETURN
+ *   CACHE_HIT on cache hit, CACHE_MISS otherwise
+ */
+static int access_level(struct cache *c, unsigned int addr, bool write, unsigned int *block, unsigned int *latency)
+{
+	unsigned int set = (addr >> c->index_shift) & c->index_mask;
+	unsigned int first = set * c->nr_ways;
+	int way = find_way(&c->tags[first], c->nr_ways, addr >> c->tag_shift);
+	int kind = c->shadow ? classify_access(c, addr) : MISS_COMPULSORY;
+	bool dirty = write;
+
+	if(way >= 0)
+	{
+		c->hits++;
+		c->timestamps[first + way] = cycles;
+		c->policy->hit(c, set, way);
+		if(write && c->write_through)
+			write_next(c, addr);
+		else if(write)
+			c->dirty[first + way] = CB_DIRTY;
+		*block = first + way;
+		*latency += c->hit_cycles + take_write_stall(c);
+		return CACHE_HIT;
+	}
+
+	c->misses++;
+	if(c->shadow)
+	{
+		c->misses_by_kind[kind]++;
+		//victim cache에 있으면 victim cache가 살려낸 miss
+		if(c->next == &victim_cache && find_block(&victim_cache, addr) >= 0)
+			c->recovered[kind]++;
+	}
+
+	//no-write-allocate면 채우지 않고 아래로 바로 쓴다
+	if(write && c->no_write_allocate)
+	{
+		write_next(c, addr);
+		*block = INVALID_TAG;
+		*latency += c->hit_cycles + take_write_stall(c);
+		return CACHE_MISS;
+	}
+	if(c->write_through)
+		dirty = false;
+
+	c->bytes_read += c->block_size;
+	fetch_block(c->next, addr, &dirty, latency);
+	*block = fill_block(c, addr, dirty);
+	if(write && c->write_through)
+		write_next(c, addr);
+	*latency += take_write_stall(c);
+	return CACHE_MISS;
+}
+
+
+/**************************************************************************
+ * Prefetchers
+ *
+ * DESCRIPTION
+ *   A prefetcher selected with '-p' option brings the blocks that it expects
+ *   to be accessed soon into @cache before they are demanded. It is trained
+ *   by the loads, and issues prefetches on the load misses and on the first
+ *   hits to prefetched blocks (so that a stream keeps going ahead). The
+ *   prefetchers are
+ *
+ *   next-line : The next @prefetch_degree blocks
+ *   stride    : Reference prediction table indexed by the 4 KB region of the
+ *               address. Once an entry has seen the same stride twice, the
+ *               blocks @prefetch_degree strides ahead are prefetched
+ *   stride-pc : Same as stride but indexed by the pc of the load, which is
+ *               given through @set_access_pc(). Traces have no pc, so all the
+ *               loads share an entry when replaying them
+ *   stream    : Up to NR_STREAMS streams of misses moving up or down within
+ *               STREAM_WINDOW blocks. A stream seen twice in a row prefetches
+ *               the next @prefetch_degree blocks in its direction
+ *
+ *   A prefetch does not stall the processor, and the block is ready after
+ *   the time taken to bring it. A prefetched block is
+ *
+ *   useful    : if demanded after it is ready
+ *   late      : if demanded before it is ready. The demand waits for the rest
+ *   useless   : if evicted without being demanded
+ *
+ *   A demand miss on a block that a prefetch has evicted is counted as a
+ *   polluting miss, using a direct-mapped filter of the evicted blocks.
+ */
+#define RPT_ENTRIES				64
+#define RPT_REGION_SHIFT		12
+#define RPT_CONFIDENT			2
+#define NR_STREAMS				8
+#define STREAM_WINDOW			4
+#define POLLUTION_FILTER_SIZE	1024
+
+struct prefetcher {
+	const char *name;
+	int degree;		/* Default @prefetch_degree */
+	void (*train)(struct cache *c, unsigned int addr, bool trigger);
+};
+
+/* Prefetcher of @cache and how far it goes ahead. Set by '-p' option */
+static const struct prefetcher *prefetcher = NULL;
+static int prefetch_degree = 0;
+
+/* pc of the access being simulated. 0 unless the program sets it */
+static unsigned int access_pc = 0;
+
+static struct rpt_entry {
+	unsigned int tag;
+	unsigned int last_addr;
+	int stride;
+	int confidence;		/* 2-bit saturating counter */
+} rpt[RPT_ENTRIES];
+
+static struct stream {
+	bool valid;
+	unsigned int last_block;	/* Block number of the last access */
+	int direction;				/* 1 for up, -1 for down, 0 if unknown yet */
+	int confidence;
+	unsigned long long used;	/* For replacing the least recently used stream */
+} streams[NR_STREAMS];
+static unsigned long long stream_clock = 0;
+
+/* Addresses of the blocks evicted by prefetches */
+static unsigned int pollution_filter[POLLUTION_FILTER_SIZE];
+
+void set_access_pc(unsigned int pc)
+{
+	access_pc = pc;
+}
+
+static void reset_prefetcher(void)
+{
+	memset(rpt, 0x00, sizeof(rpt));
+	memset(streams, 0x00, sizeof(streams));
+	stream_clock = 0;
+	for(int i = 0; i < POLLUTION_FILTER_SIZE; i++)
+	{
+		pollution_filter[i] = INVALID_TAG;
+	}
+}
+
+/* Prefetch the block containing @addr into @c unless @c already has it */
+static void prefetch_block(struct cache *c, unsigned int addr)
+{
+	unsigned int set = (addr >> c->index_shift) & c->index_mask;
+	unsigned int first = set * c->nr_ways;
+	unsigned int latency = 0, block;
+	bool dirty = false;
+	int way;
+
+	if(find_block(c, addr) >= 0)
+		return;
+
+	c->bytes_read += c->block_size;
+	fetch_block(c->next, addr, &dirty, &latency);
+
+	//victim을 여기서 골라서 쫓아내야 pollution filter에 적을 수 있다
+	way = find_way(&c->tags[first], c->nr_ways, INVALID_TAG);
+	if(way < 0)
+	{
+		unsigned int victim = first + c->policy->victim(c, set);
+		unsigned int victim_addr = block_address(c, victim);
+
+		pollution_filter[(victim_addr >> c->index_shift) % POLLUTION_FILTER_SIZE] = victim_addr;
+		evict_block(c, victim);
+	}
+	block = fill_block(c, addr, dirty);
+
+	c->prefetched[block] = true;
+	c->ready[block] = cycles + latency;
+	c->prefetches++;
+}
+
+static void train_next_line(struct cache *c, unsigned int addr, bool trigger)
+{
+	if(!trigger)
+		return;
+	for(int i = 1; i <= prefetch_degree; i++)
+	{
+		prefetch_block(c, (addr & ~c->offset_mask) + i * c->block_size);
+	}
+}
+
+static void train_stride(struct cache *c, unsigned int key, unsigned int addr, bool trigger)
+{
+	struct rpt_entry *e = &rpt[key % RPT_ENTRIES];
+	int stride = addr - e->last_addr;
+	int step;
+
+	if(e->tag != key)
+	{
+		e->tag = key;
+		e->last_addr = addr;
+		e->stride = 0;
+		e->confidence = 0;
+		return;
+	}
+
+	if(stride == e->stride)
+	{
+		if(e->confidence < 3)
+			e->confidence++;
+	}
+	else if(e->confidence > 0)
+		e->confidence--;
+	else
+		e->stride = stride;
+	e->last_addr = addr;
+
+	if(!trigger || e->confidence < RPT_CONFIDENT || e->stride == 0)
+		return;
+
+	//stride가 block보다 작으면 같은 block만 다시 가져오게 되니 block 단위로 간다
+	step = e->stride;
+	if(abs(step) < (int)c->block_size)
+		step = step > 0 ? (int)c->block_size : -(int)c->block_size;
+	for(int i = 1; i <= prefetch_degree; i++)
+	{
+		prefetch_block(c, addr + i * step);
+	}
+}
+
+static void train_stride_addr(struct cache *c, unsigned int addr, bool trigger)
+{
+	train_stride(c, addr >> RPT_REGION_SHIFT, addr, trigger);
+}
+
+static void train_stride_pc(struct cache *c, unsigned int addr, bool trigger)
+{
+	train_stride(c, access_pc >> 2, addr, trigger);
+}
+
+static void train_stream(struct cache *c, unsigned int addr, bool trigger)
+{
+	unsigned int block = addr >> c->index_shift;
+	struct stream *s = NULL, *lru = &streams[0];
+	int direction;
+
+	if(!trigger)
+		return;
+	stream_clock++;
+
+	for(int i = 0; i < NR_STREAMS; i++)
+	{
+		if(streams[i].valid && block - streams[i].last_block + STREAM_WINDOW <= 2 * STREAM_WINDOW)
+		{
+			s = &streams[i];
+			break;
+		}
+		if(!streams[i].valid || streams[i].used < lru->used)
+			lru = &streams[i];
+	}
+
+	//맞는 stream이 없으면 가장 오래된 stream을 새로 시작한다
+	if(s == NULL)
+	{
+		lru->valid = true;
+		lru->last_block = block;
+		lru->direction = 0;
+		lru->confidence = 0;
+		lru->used = stream_clock;
+		return;
+	}
+	s->used = stream_clock;
+	if(block == s->last_block)
+		return;
+
+	direction = block > s->last_block ? 1 : -1;
+	if(direction == s->direction)
+	{
+		if(s->confidence < 3)
+			s->confidence++;
+	}
+	else
+	{
+		s->direction = direction;
+		s->confidence = 0;
+	}
+	s->last_block = block;
+
+	if(s->confidence < 1)
+		return;
+	for(int i = 1; i <= prefetch_degree; i++)
+	{
+		prefetch_block(c, (block + direction * i) << c->index_shift);
+	}
+}
+
+static const struct prefetcher prefetchers[] = {
+	{ "next-line", 1, train_next_line },
+	{ "stride", 1, train_stride_addr },
+	{ "stride-pc", 1, train_stride_pc },
+	{ "stream", 4, train_stream },
+};
+
+/**************************************************************************
+ * parse_prefetcher(spec)
+ *
+ * DESCRIPTION
+ *   Select the prefetcher with @spec given to '-p' option, which is the name
+ *   of the prefetcher optionally followed by ":degree".
+ *
+ * RETURN
+ *   0 on success, -1 if @spec is malformed
+ */
+static int parse_prefetcher(const char *spec)
+{
+	char name[16] = "";
+	int degree = 0;
+
+	if(sscanf(spec, "%15[^:]:%d", name, &degree) < 1)
+		return -1;
+
+	for(size_t i = 0; i < sizeof(prefetchers) / sizeof(*prefetchers); i++)
+	{
+		if(strmatch(name, prefetchers[i].name))
+		{
+			prefetcher = &prefetchers[i];
+			prefetch_degree = degree > 0 ? degree : prefetchers[i].degree;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**************************************************************************
+ * prefetch_access(c, addr, block, hit, load)
+ *
+ * DESCRIPTION
+ *   Account the demand access for @addr to @block of @c for the prefetches,
+ *   and train the prefetcher of @c if the access is a load. @hit is the
+ *   result of the access.
+ *
+ * RETURN
+ *   The clock cycles to wait for a late prefetch
+ */
+static unsigned int prefetch_access(struct cache *c, unsigned int addr, unsigned int block, int hit, bool load)
+{
+	unsigned int wait = 0;
+	bool trigger = true;
+
+	if(hit == CACHE_HIT)
+	{
+		trigger = c->prefetched[block];
+		if(c->prefetched[block] && c->ready[block] > cycles)
+		{
+			c->late_prefetches++;
+			wait = c->ready[block] - cycles;
+		}
+		else if(c->prefetched[block])
+			c->useful_prefetches++;
+		c->prefetched[block] = false;
+	}
+	else
+	{
+		unsigned int *evicted = &pollution_filter[(addr >> c->index_shift) % POLLUTION_FILTER_SIZE];
+
+		if(*evicted == (addr & ~c->offset_mask))
+		{
+			c->polluting_misses++;
+			*evicted = INVALID_TAG;
+		}
+	}
+
+	if(load)
+		c->prefetcher->train(c, addr, trigger);
+	return wait;
+}
+
+
+/**************************************************************************
+ * load_word(addr)
+ *
+ * DESCRIPTION
+ *   Simulate the case when the processor is handling a lw instruction for @addr.
+ *   To that end, you should first look up the cache blocks to find the block
+ *   containing the target address @addr. If exists, it's cache hit; return
+ *   CACHE_HIT after updating the cache block's timestamp with @cycles.
+ *   Otherwise, replace the LRU cache block in the set. Should handle dirty
+ *   blocks properly according to the write-back semantic.
+ *
+ *   @cycles is advanced by the time taken to access @addr.
+ *
+ * PARAMETERS
+ *   @addr: Target address to load
+ *
+ * RETURN
+ *   CACHE_HIT on cache hit, CACHE_MISS otherwise
+ *
+ */
+int load_word(unsigned int addr)
+{
+	unsigned int block, latency = 0;
+	int hit = access_level(&cache, addr, false, &block, &latency);
+
+	if(cache.prefetcher)
+		latency += prefetch_access(&cache, addr, block, hit, true);
+	cycles += latency;
+	return hit;
+}
+
+
+/**************************************************************************
+ * store_word(addr, data)
+ *
+ * DESCRIPTION
+ *   Simulate the case when the processor is handling the 'sw' instruction.
+ *   Cache should be write-back and write-allocate. Note that the least
+ *   recently used (LRU) block should be replaced in case of eviction.
+ *   '-w' option may select another write policy (see 'Write policies').
+ *
+ *   @cycles is advanced by the time taken to access @addr.
+ *
+ * PARAMETERS
+ *   @addr: Starting address for @data
+ *   @data: New value for @addr. Assume that @data is 1-word in size
+ *
+ * RETURN
+ *   CACHE_HIT on cache hit, CACHE_MISS otherwise
+ *
+ */
+int store_word(unsigned int addr, unsigned int data)
+{
+	unsigned int block, latency = 0;
+	int hit = access_level(&cache, addr, true, &block, &latency);
+
+	if(cache.prefetcher)
+		latency += prefetch_access(&cache, addr, block, hit, false);
+
+	if(cache.data)
+	{
+		//big endian으로 저장
+		unsigned char word[BYTES_PER_WORD] = { data >> 24, data >> 16, data >> 8, data };
+
+		//block 안에서 word의 위치
+		if(block != INVALID_TAG)
+			memcpy(&cache.data[block * cache.block_size + (addr & cache.offset_mask & ~(BYTES_PER_WORD - 1))], word, BYTES_PER_WORD);
+		//write-through나 할당하지 않은 miss는 memory에도 바로 쓴다
+		if(cache.write_through || block == INVALID_TAG)
+			write_block(addr & ~(BYTES_PER_WORD - 1), word, BYTES_PER_WORD);
+	}
+
+	cycles += latency;
+	return hit;
+}
+
+
+/**************************************************************************
+ * fetch_word(addr)
+ *
+ * DESCRIPTION
+ *   Simulate fetching the instruction at @addr. The instruction is fetched
+ *   through @icache if it is configured, and through @cache otherwise.
+ *
+ * RETURN
+ *   CACHE_HIT on cache hit, CACHE_MISS otherwise
+ */
+int fetch_word(unsigned int addr)
+{
+	struct cache *c = icache.nr_blocks ? &icache : &cache;
+	unsigned int block, latency = 0;
+	int hit = access_level(c, addr, false, &block, &latency);
+
+	if(c->prefetcher)
+		latency += prefetch_access(c, addr, block, hit, false);
+	cycles += latency;
+	return hit;
+}
+
+
+/**************************************************************************
+ * setup_cache(c, name, level)
+ *
+ * DESCRIPTION
+ *   Derive the geometry of @c from its @nr_words_per_block, @nr_blocks, and
+ *   @nr_ways. @c uses @policy unless it has its own policy.
+ */
+static void setup_cache(struct cache *c, const char *name, int level)
+{
+	c->name = name;
+	c->level = level;
+	if(c->policy == NULL)
+		c->policy = policy;
+	c->nr_sets = c->nr_blocks / c->nr_ways;
+	if(c->nr_sets < 1)
+		c->nr_sets = 1;
+
+	//tree-PLRU는 way 수가 2의 거듭제곱이어야 한다.
+	if(c->policy->victim == victim_plru && (c->nr_ways & (c->nr_ways - 1)))
+	{
+		fprintf(stderr, "plru needs a power-of-two number of ways. lru is used for %s instead\n", name);
+		c->policy = find_policy("lru");
+	}
+
+	//크기는 모두 2의 거듭제곱이라서 나눗셈 대신 shift와 mask로 나눈다.
+	c->block_size = c->nr_words_per_block * BYTES_PER_WORD;
+	c->offset_mask = c->block_size - 1;
+	//block 안의 offset bit 수. 이만큼 버리면 set index가 나온다.
+	c->index_shift = log2_discrete(c->block_size);
+	c->index_mask = c->nr_sets - 1;
+	//offset bit + index bit 수. 이만큼 버리면 tag가 나온다.
+	c->tag_shift = c->index_shift + log2_discrete(c->nr_sets);
+}
+
+/**************************************************************************
+ * alloc_cache(c, with_data) / free_cache(c)
+ *
+ * DESCRIPTION
+ *   Allocate and release the blocks of @c. The contents are allocated only
+ *   if @with_data is set.
+ *
+ * RETURN
+ *   0 on success, -1 if out of memory
+ */
+static int alloc_cache(struct cache *c, bool with_data)
+{
+	c->tags = malloc(sizeof(*c->tags) * c->nr_blocks);
+	c->valid = calloc(c->nr_blocks, sizeof(*c->valid));
+	c->dirty = calloc(c->nr_blocks, sizeof(*c->dirty));
+	c->timestamps = calloc(c->nr_blocks, sizeof(*c->timestamps));
+	c->data = with_data ? calloc(c->nr_blocks, c->block_size) : NULL;
+	if(!c->tags || !c->valid || !c->dirty || !c->timestamps || (with_data && !c->data))
+		return -1;
+
+	for(int i = 0; i < c->nr_blocks; i++)
+	{
+		c->tags[i] = INVALID_TAG;
+	}
+
+	if(c->prefetcher)
+	{
+		c->prefetched = calloc(c->nr_blocks, sizeof(*c->prefetched));
+		c->ready = calloc(c->nr_blocks, sizeof(*c->ready));
+		if(!c->prefetched || !c->ready)
+			return -1;
+		reset_prefetcher();
+	}
+	if(c->classify && init_shadow(c))
+		return -1;
+
+	c->write_head = c->write_count = 0;
+	if(c->nr_write_entries)
+	{
+		c->write_blocks = malloc(sizeof(*c->write_blocks) * c->nr_write_entries);
+		c->write_words = malloc(sizeof(*c->write_words) * c->nr_write_entries);
+		c->write_done = malloc(sizeof(*c->write_done) * c->nr_write_entries);
+		if(!c->write_blocks || !c->write_words || !c->write_done)
+			return -1;
+	}
+	return c->policy->init(c);
+}
+
+static void free_cache(struct cache *c)
+{
+	free(c->tags);
+	free(c->valid);
+	free(c->dirty);
+	free(c->timestamps);
+	free(c->data);
+	free(c->prefetched);
+	free(c->ready);
+	free(c->write_blocks);
+	free(c->write_words);
+	free(c->write_done);
+	free_shadow(c);
+	free_policy(c);
+}
+
+/**************************************************************************
+ * parse_level(spec, c)
+ *
+ * DESCRIPTION
+ *   Configure @c with @spec given to '-i' and '-l' options, which is
+ *   "words per block:number of blocks:number of ways:hit cycles" optionally
+ *   followed by ":inclusive", ":exclusive", or ":nine".
+ *
+ * RETURN
+ *   0 on success, -1 if @spec is malformed
+ */
+static int parse_level(const char *spec, struct cache *c)
+{
+	char inclusion[16] = "nine";
+	int nr_fields = sscanf(spec, "%d:%d:%d:%d:%15s",
+			&c->nr_words_per_block, &c->nr_blocks, &c->nr_ways, &c->hit_cycles, inclusion);
+
+	if(nr_fields < 4 || c->nr_words_per_block < 1 || c->nr_blocks < 1 ||
+			c->nr_ways < 1 || c->nr_ways > c->nr_blocks)
+		return -1;
+
+	for(size_t i = 0; i < sizeof(inclusion_names) / sizeof(*inclusion_names); i++)
+	{
+		if(strmatch(inclusion, inclusion_names[i]))
+		{
+			c->inclusion = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**************************************************************************
+ * check_exclusive_levels
+ *
+ * DESCRIPTION
+ *   Check that each exclusive level has the same block size as the levels
+ *   right above it. Blocks are moved between an exclusive level and the
+ *   level above as a whole, so a block of another size cannot be tracked.
+ *
+ * RETURN
+ *   0 if the levels are fine, -1 otherwise
+ */
+static int check_exclusive_levels(void)
+{
+	for(int i = 0; i < nr_lower_levels; i++)
+	{
+		struct cache *c = &lower_levels[i];
+
+		if(c->inclusion != INCLUSION_EXCLUSIVE)
+			continue;
+		if(i > 0 && c->nr_words_per_block != lower_levels[i - 1].nr_words_per_block)
+			return -1;
+		if(i == 0 && (c->nr_words_per_block != nr_words_per_block ||
+					(icache.nr_blocks && c->nr_words_per_block != icache.nr_words_per_block)))
+			return -1;
+	}
+	return 0;
+}
+
+/**************************************************************************
+ * print_miss_kinds
+ *
+ * DESCRIPTION
+ *   Print the misses of @cache by their kinds, and how many of them the
+ *   victim cache has recovered.
+ */
+static void print_miss_kinds(void)
+{
+	printf("%s misses:", cache.name);
+	for(int i = 0; i < NR_MISS_KINDS; i++)
+	{
+		printf("  %s %llu", miss_kind_names[i], cache.misses_by_kind[i]);
+	}
+	printf("\n");
+
+	if(cache.next != &victim_cache)
+		return;
+	printf("recovered by VC:");
+	for(int i = 0; i < NR_MISS_KINDS; i++)
+	{
+		printf("  %s %llu", miss_kind_names[i], cache.recovered[i]);
+	}
+	printf("  (%.2f%% of conflict misses)\n", cache.misses_by_kind[MISS_CONFLICT] ?
+			100.0 * cache.recovered[MISS_CONFLICT] / cache.misses_by_kind[MISS_CONFLICT] : 0.0);
+}
+
+/**************************************************************************
+ * print_stats
+ *
+ * DESCRIPTION
+ *   Print the hits, misses, and write-backs of each level, the prefetches,
+ *   the kinds of the misses, and the average memory access time (AMAT) so
+ *   far.
+ */
+static void print_stats(void)
+{
+	unsigned long long nr_accesses = cache.hits + cache.misses + icache.hits + icache.misses;
+
+	printf("level  %12s %12s %10s %12s %12s %14s %14s\n",
+			"hits", "misses", "miss rate", "writebacks", "invalidated", "read bytes", "written bytes");
+	for(int i = 0; i < nr_levels; i++)
+	{
+		struct cache *c = levels[i];
+		unsigned long long nr_lookups = c->hits + c->misses;
+
+		printf("%-6s %12llu %12llu %9.2f%% %12llu %12llu %14llu %14llu\n", c->name, c->hits, c->misses,
+				nr_lookups ? 100.0 * c->misses / nr_lookups : 0.0, c->writebacks, c->back_invalidations,
+				c->bytes_read, c->bytes_written);
+	}
+	if(cache.timed_writes)
+	{
+		printf("%s write-%s %s, %d-entry write buffer, %llu cycles stalled\n", cache.name,
+				cache.write_through ? "through" : "back", cache.no_write_allocate ? "no-allocate" : "allocate",
+				cache.nr_write_entries, cache.write_stalls);
+	}
+	if(cache.prefetcher)
+	{
+		printf("prefetch %s:%d  issued %llu  useful %llu  late %llu  useless %llu  polluting misses %llu\n",
+				cache.prefetcher->name, prefetch_degree, cache.prefetches, cache.useful_prefetches,
+				cache.late_prefetches, cache.useless_prefetches, cache.polluting_misses);
+	}
+	if(cache.shadow)
+		print_miss_kinds();
+	printf("AMAT %.2f cycles over %llu accesses\n", nr_accesses ? (double)cycles / nr_accesses : 0.0, nr_accesses);
+}
+
+
+/**************************************************************************
+ * init_simulator
+ *
+ * DESCRIPTION
+ *   This function is called before starting the simulation. This is the
+ *   perfect place to put your initialization code. You may leave this function
+ *   empty if you'd like.
+ */
+void init_simulator(void)
+{
+	struct cache *next = nr_lower_levels ? &lower_levels[0] : NULL;
+	static char names[MAX_LEVELS][8];
+
+	if(memory_cycles == 0)
+		memory_cycles = cycles_miss;
+	if(policy == NULL)
+		policy = find_policy("lru");
+
+	cache.nr_words_per_block = nr_words_per_block;
+	cache.nr_blocks = nr_blocks;
+	cache.nr_ways = nr_ways;
+	cache.hit_cycles = cycles_hit;
+	cache.next = next;
+	cache.prefetcher = prefetcher;
+	cache.classify = classify_misses;
+	cache.timed_writes = timed_writes;
+	cache.write_through = write_through;
+	cache.no_write_allocate = no_write_allocate;
+	cache.nr_write_entries = timed_writes ? write_buffer_depth : 0;
+	setup_cache(&cache, icache.nr_blocks ? "L1D" : "L1", 1);
+	levels[nr_levels++] = &cache;
+	nr_sets = cache.nr_sets;
+
+	if(icache.nr_blocks)
+	{
+		icache.next = next;
+		setup_cache(&icache, "L1I", 1);
+		levels[nr_levels++] = &icache;
+	}
+	if(nr_victims)
+	{
+		victim_cache.nr_words_per_block = nr_words_per_block;
+		victim_cache.nr_blocks = victim_cache.nr_ways = nr_victims;
+		victim_cache.hit_cycles = cycles_hit;
+		victim_cache.inclusion = INCLUSION_EXCLUSIVE;
+		victim_cache.policy = find_policy("lru");
+		victim_cache.next = next;
+		setup_cache(&victim_cache, "VC", 1);
+		levels[nr_levels++] = &victim_cache;
+		cache.next = &victim_cache;
+	}
+	for(int i = 0; i < nr_lower_levels; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "L%d", i + 2);
+		lower_levels[i].next = i + 1 < nr_lower_levels ? &lower_levels[i + 1] : NULL;
+		setup_cache(&lower_levels[i], names[i], i + 2);
+		levels[nr_levels++] = &lower_levels[i];
+	}
+
+	//level이 여럿이면 block 크기가 서로 달라서 내용은 따라가지 않는다.
+	if(nr_levels > 1)
+		dataless = true;
+}
+
+
+
+#ifndef CACHE_SIM_LIBRARY
+/**************************************************************************
+ * Trace replay
+ *
+ * DESCRIPTION
+ *   Typing 'lw' and 'sw' commands does not scale to the memory traces of
+ *   real programs, which have billions of accesses. 'trace' command replays
+ *   a binary trace file instead. The file is a sequence of records;
+ *
+ *     TRACE_LOAD  : 1-byte op, 4-byte address                  (5 bytes)
+ *     TRACE_STORE : 1-byte op, 4-byte address, 4-byte value    (9 bytes)
+ *     TRACE_FETCH : 1-byte op, 4-byte address                  (5 bytes)
+ *
+ *   where the address and the value are big-endian. The file is read in
+ *   chunks of TRACE_BUFFER_SIZE bytes and the records are fed to
+ *   @load_word(), @store_word(), and @fetch_word() directly.
+ *
+ *   The upper 4 bits of the op are the ID of the core making the access
+ *   for 'coherence' command. The other commands ignore it.
+ */
+#define TRACE_LOAD			0
+#define TRACE_STORE			1
+#define TRACE_FETCH			2
+#define TRACE_BUFFER_SIZE	(4 << 20)
+
+#define TRACE_OP(op)		((op) & 0x0f)
+#define TRACE_CORE(op)		((op) >> 4)
+
+static inline unsigned int get_be32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**************************************************************************
+ * replay_records(records, length, hits, misses)
+ *
+ * DESCRIPTION
+ *   Simulate the accesses in @records of @length bytes, and add the results
+ *   to @hits and @misses. A record cut at the end of @records is
+ *   left for the next call.
+ *
+ * RETURN
+ *   The number of bytes consumed
+ *   -1 if @records has an unknown op
+ */
+static long replay_records(const unsigned char *records, size_t length,
+		unsigned long long *hits, unsigned long long *misses)
+{
+	size_t i = 0;
+
+	while(i < length)
+	{
+		size_t record_size = TRACE_OP(records[i]) == TRACE_STORE ? 9 : 5;
+		int hit;
+
+		if(length - i < record_size)
+			break;
+
+		if(TRACE_OP(records[i]) == TRACE_LOAD)
+			hit = load_word(get_be32(records + i + 1));
+		else if(TRACE_OP(records[i]) == TRACE_STORE)
+			hit = store_word(get_be32(records + i + 1), get_be32(records + i + 5));
+		else if(TRACE_OP(records[i]) == TRACE_FETCH)
+			hit = fetch_word(get_be32(records + i + 1));
+		else
+			return -1;
+
+		if(hit == CACHE_HIT)
+			(*hits)++;
+		else
+			(*misses)++;
+		i += record_size;
+	}
+	return i;
+}
+
+/**************************************************************************
+ * replay_trace(filename, hits, misses)
+ *
+ * DESCRIPTION
+ *   Replay the trace file @filename, and report how many records are
+ *   simulated with the hits, misses, and @cycles so far.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int replay_trace(const char *filename, unsigned long long *hits, unsigned long long *misses)
+{
+	FILE *trace = fopen(filename, "rb");
+	unsigned char *buffer;
+	size_t length = 0, nr_read;
+	unsigned long long nr_records = *hits + *misses;
+	struct timespec start, end;
+	double seconds;
+	int ret = 0;
+
+	if(trace == NULL)
+	{
+		perror("Trace file error");
+		return -1;
+	}
+	buffer = malloc(TRACE_BUFFER_SIZE);
+	if(buffer == NULL)
+	{
+		fclose(trace);
+		return -1;
+	}
+
+	timespec_get(&start, TIME_UTC);
+	while((nr_read = fread(buffer + length, 1, TRACE_BUFFER_SIZE - length, trace)) > 0)
+	{
+		long consumed = replay_records(buffer, length + nr_read, hits, misses);
+
+		if(consumed < 0)
+		{
+			fprintf(stderr, "Invalid record in %s\n", filename);
+			ret = -1;
+			break;
+		}
+		//잘린 record는 buffer 앞으로 옮겨서 다음에 이어 읽는다.
+		length = length + nr_read - consumed;
+		memmove(buffer, buffer + consumed, length);
+	}
+	if(ret == 0 && length > 0)
+		fprintf(stderr, "Trailing %zu bytes in %s are ignored\n", length, filename);
+	timespec_get(&end, TIME_UTC);
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	nr_records = *hits + *misses - nr_records;
+	printf("%llu records in %.3f s (%.2f M records/s)\n",
+			nr_records, seconds, seconds > 0 ? nr_records / seconds / 1e6 : 0.0);
+	printf("hits %llu  misses %llu  cycles %llu\n", *hits, *misses, cycles);
+	if(nr_levels > 1 || cache.prefetcher)
+		print_stats();
+
+	free(buffer);
+	fclose(trace);
+	return ret;
+}
+
+
+/**************************************************************************
+ * map_trace(filename, size) / unmap_trace(trace, size)
+ *
+ * DESCRIPTION
+ *   Map the whole trace file @filename read-only, and store its size into
+ *   @size. The file is read into a buffer on the systems without mmap().
+ *
+ * RETURN
+ *   The contents of the file. NULL on failure
+ */
+static const unsigned char *map_trace(const char *filename, size_t *size)
+{
+#ifndef _WIN32
+	struct stat st;
+	void *trace;
+	int fd = open(filename, O_RDONLY);
+
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	trace = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(trace == MAP_FAILED)
+		return NULL;
+	madvise(trace, st.st_size, MADV_SEQUENTIAL);
+
+	*size = st.st_size;
+	return trace;
+#else
+	FILE *input = fopen(filename, "rb");
+	unsigned char *trace;
+	long length;
+
+	if(input == NULL)
+		return NULL;
+	fseek(input, 0, SEEK_END);
+	length = ftell(input);
+	rewind(input);
+
+	trace = length > 0 ? malloc(length) : NULL;
+	if(trace && fread(trace, length, 1, input) != 1)
+	{
+		free(trace);
+		trace = NULL;
+	}
+	fclose(input);
+
+	*size = length;
+	return trace;
+#endif
+}
+
+static void unmap_trace(const unsigned char *trace, size_t size)
+{
+#ifndef _WIN32
+	munmap((void *)trace, size);
+#else
+	free((void *)trace);
+#endif
+}
+
+/* Read the address of the record at @record into @addr, and move @record to
+ * the next record. Returns the op with the core ID, or -1 if the record is broken */
+static inline int next_record(const unsigned char **record, const unsigned char *end, unsigned int *addr)
+{
+	const unsigned char *p = *record;
+	size_t record_size = TRACE_OP(p[0]) == TRACE_STORE ? 9 : 5;
+
+	if(TRACE_OP(p[0]) > TRACE_FETCH || (size_t)(end - p) < record_size)
+		return -1;
+	*addr = get_be32(p + 1);
+	*record = p + record_size;
+	return p[0];
+}
+
+
+/**************************************************************************
+ * Sweep
+ *
+ * DESCRIPTION
+ *   Drawing a miss-rate curve takes a run for every cache size. Instead,
+ *   'sweep' command computes the misses of LRU caches of all the sizes with
+ *   a block size from a single pass over a trace, using the stack distances
+ *   of Mattson et al. For each number of sets S (1, 2, 4, ...), every set
+ *   keeps the blocks mapped to it in a stack in the recency order. An access
+ *   to the block at depth d of the stack hits in an S-set cache with more
+ *   than d ways, so counting the depths gives the misses for all the
+ *   associativities at once. The stacks are kept up to @max_ways deep.
+ *
+ *   The caches are simulated without their contents, and the loads, the
+ *   stores, and the fetches all go to the same cache.
+ */
+struct stack_level {
+	unsigned int nr_sets;
+	unsigned int *stacks;				/* @max_ways blocks for each set */
+	unsigned int *depths;				/* Number of blocks in each stack */
+	unsigned long long *histogram;		/* Accesses at each depth. The last is for misses */
+};
+
+/* The columns are the powers of two below @max_ways and @max_ways. 0 after @max_ways */
+static int next_column(int ways, int max_ways)
+{
+	if(ways >= max_ways)
+		return 0;
+	return ways * 2 < max_ways ? ways * 2 : max_ways;
+}
+
+/**************************************************************************
+ * sweep_trace(filename, words, max_ways, max_blocks)
+ *
+ * DESCRIPTION
+ *   Print the misses of the LRU caches with @words words per block, up to
+ *   @max_ways ways, and up to @max_blocks blocks for the trace @filename.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int sweep_trace(const char *filename, int words, int max_ways, int max_blocks)
+{
+	const unsigned char *trace, *record, *end;
+	size_t size;
+	struct stack_level *stack_levels;
+	int nr_stack_levels;
+	unsigned int block_shift;
+	unsigned long long nr_accesses = 0;
+	unsigned int addr;
+	int ret = -1;
+
+	if(words < 1 || words > MAX_NR_WORDS_PER_BLOCK || (words & (words - 1)) ||
+			max_ways < 1 || max_blocks < max_ways)
+	{
+		printf("Wrong input for sweep\n");
+		return -1;
+	}
+	//set 수 1, 2, 4, ... 마다 stack을 따로 둔다
+	nr_stack_levels = log2_discrete(max_blocks / max_ways) + 1;
+	block_shift = log2_discrete(words * BYTES_PER_WORD);
+
+	trace = map_trace(filename, &size);
+	if(trace == NULL)
+	{
+		perror("Trace file error");
+		return -1;
+	}
+
+	stack_levels = calloc(nr_stack_levels, sizeof(*stack_levels));
+	if(stack_levels == NULL)
+		goto out;
+	for(int i = 0; i < nr_stack_levels; i++)
+	{
+		stack_levels[i].nr_sets = 1 << i;
+		stack_levels[i].stacks = malloc(sizeof(unsigned int) * max_ways << i);
+		stack_levels[i].depths = calloc(1 << i, sizeof(unsigned int));
+		stack_levels[i].histogram = calloc(max_ways + 1, sizeof(unsigned long long));
+		if(!stack_levels[i].stacks || !stack_levels[i].depths || !stack_levels[i].histogram)
+			goto out;
+	}
+
+	record = trace;
+	end = trace + size;
+	while(record < end)
+	{
+		unsigned int block;
+
+		if(next_record(&record, end, &addr) < 0)
+		{
+			fprintf(stderr, "Invalid record in %s\n", filename);
+			goto out;
+		}
+		block = addr >> block_shift;
+		nr_accesses++;
+
+		for(int i = 0; i < nr_stack_levels; i++)
+		{
+			struct stack_level *l = &stack_levels[i];
+			unsigned int set = block & (l->nr_sets - 1);
+			unsigned int *stack = &l->stacks[set * max_ways];
+			unsigned int depth = 0;
+
+			//stack에서 찾은 깊이가 곧 stack distance
+			while(depth < l->depths[set] && stack[depth] != block)
+				depth++;
+
+			if(depth == l->depths[set])
+			{
+				l->histogram[max_ways]++;
+				if(l->depths[set] < (unsigned int)max_ways)
+					l->depths[set]++;
+				//꽉 찼으면 맨 아래 block은 버려진다
+				depth = l->depths[set] - 1;
+			}
+			else
+			{
+				l->histogram[depth]++;
+			}
+			memmove(&stack[1], &stack[0], depth * sizeof(*stack));
+			stack[0] = block;
+		}
+	}
+
+	printf("Misses of LRU caches with %d-byte blocks over %llu accesses\n", words * BYTES_PER_WORD, nr_accesses);
+	printf("%8s", "sets");
+	for(int ways = 1; ways; ways = next_column(ways, max_ways))
+		printf(" %10d-way", ways);
+	printf("\n");
+
+	for(int i = 0; i < nr_stack_levels; i++)
+	{
+		unsigned long long misses = nr_accesses;
+		int depth = 0;
+
+		printf("%8u", stack_levels[i].nr_sets);
+		for(int ways = 1; ways; ways = next_column(ways, max_ways))
+		{
+			for(; depth < ways; depth++)
+				misses -= stack_levels[i].histogram[depth];
+			printf(" %14llu", misses);
+		}
+		printf("\n");
+	}
+	ret = 0;
+
+out:
+	for(int i = 0; stack_levels && i < nr_stack_levels; i++)
+	{
+		free(stack_levels[i].stacks);
+		free(stack_levels[i].depths);
+		free(stack_levels[i].histogram);
+	}
+	free(stack_levels);
+	unmap_trace(trace, size);
+	return ret;
+}
+
+
+/**************************************************************************
+ * Parallel simulation
+ *
+ * DESCRIPTION
+ *   'parallel' command simulates independent caches over a trace on a pool
+ *   of threads. The caches are listed in a file, a cache per line;
+ *
+ *     [words per block] [number of blocks] [number of ways] { [policy] }
+ *
+ *   Every thread reads the same trace mapped once read-only, and takes the
+ *   next cache in the list when it has finished one. Each cache has its own
+ *   blocks and counters and is simulated without the contents, so nothing
+ *   is shared but the trace. The threads are only available on POSIX systems
+ *   (build with -pthread if needed); otherwise the caches are simulated one
+ *   after another.
+ */
+struct parallel_job {
+	struct cache cache;
+	unsigned long long cycles;
+	bool failed;
+};
+
+struct parallel {
+	const unsigned char *trace;
+	size_t size;
+	struct parallel_job *jobs;
+	int nr_jobs;
+	int next_job;		/* Next job to pick up */
+#ifndef _WIN32
+	pthread_mutex_t lock;
+#endif
+};
+
+static void run_parallel_job(struct parallel *p, struct parallel_job *job)
+{
+	const unsigned char *record = p->trace, *end = p->trace + p->size;
+	unsigned int addr, block, latency;
+	int op;
+
+	while(record < end)
+	{
+		if((op = next_record(&record, end, &addr)) < 0)
+		{
+			job->failed = true;
+			return;
+		}
+		latency = 0;
+		access_level(&job->cache, addr, TRACE_OP(op) == TRACE_STORE, &block, &latency);
+		job->cycles += latency;
+	}
+}
+
+static void *parallel_worker(void *arg)
+{
+	struct parallel *p = arg;
+
+	while(true)
+	{
+		int i;
+
+#ifndef _WIN32
+		pthread_mutex_lock(&p->lock);
+#endif
+		i = p->next_job++;
+#ifndef _WIN32
+		pthread_mutex_unlock(&p->lock);
+#endif
+		if(i >= p->nr_jobs)
+			return NULL;
+		run_parallel_job(p, &p->jobs[i]);
+	}
+}
+
+/**************************************************************************
+ * simulate_parallel(filename, list, nr_threads)
+ *
+ * DESCRIPTION
+ *   Simulate the caches in @list over the trace @filename with @nr_threads
+ *   threads, and print the hits and misses of each cache.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int simulate_parallel(const char *filename, const char *list, int nr_threads)
+{
+	struct parallel p = { .next_job = 0 };
+	FILE *input = fopen(list, "r");
+	char line[80];
+	int ret = -1;
+
+	if(input == NULL)
+	{
+		perror("Cache list error");
+		return -1;
+	}
+
+	while(fgets(line, sizeof(line), input))
+	{
+		char policy_name[16] = "";
+		struct parallel_job *jobs;
+		struct cache *c;
+		int words, blocks, ways;
+		int nr_fields = sscanf(line, "%d %d %d %15s", &words, &blocks, &ways, policy_name);
+
+		//빈 줄이나 주석은 넘어간다
+		if(nr_fields <= 0 || line[0] == '#')
+			continue;
+		//setup_cache()의 shift와 mask는 word 수와 set 수가 2의 거듭제곱이어야 맞다
+		if(nr_fields < 3 || words < 1 || words > MAX_NR_WORDS_PER_BLOCK || (words & (words - 1)) ||
+				blocks < 1 || ways < 1 || ways > blocks || blocks % ways ||
+				((blocks / ways) & (blocks / ways - 1)) ||
+				(policy_name[0] && find_policy(policy_name) == NULL))
+		{
+			printf("Wrong cache in %s: %s", list, line);
+			goto out;
+		}
+
+		jobs = realloc(p.jobs, sizeof(*p.jobs) * (p.nr_jobs + 1));
+		if(jobs == NULL)
+			goto out;
+		p.jobs = jobs;
+		memset(&p.jobs[p.nr_jobs], 0x00, sizeof(*p.jobs));
+		c = &p.jobs[p.nr_jobs++].cache;
+
+		c->nr_words_per_block = words;
+		c->nr_blocks = blocks;
+		c->nr_ways = ways;
+		c->hit_cycles = cycles_hit;
+		c->policy = policy_name[0] ? find_policy(policy_name) : NULL;
+		setup_cache(c, "", 1);
+		if(alloc_cache(c, false))
+			goto out;
+	}
+
+	p.trace = map_trace(filename, &p.size);
+	if(p.trace == NULL)
+	{
+		perror("Trace file error");
+		goto out;
+	}
+
+#ifndef _WIN32
+	if(nr_threads < 1)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(nr_threads > p.nr_jobs)
+		nr_threads = p.nr_jobs;
+	if(nr_threads > 0)
+	{
+		pthread_t *threads = malloc(sizeof(*threads) * nr_threads);
+		int nr_started = 0;
+
+		pthread_mutex_init(&p.lock, NULL);
+		for(; threads && nr_started < nr_threads; nr_started++)
+		{
+			if(pthread_create(&threads[nr_started], NULL, parallel_worker, &p))
+				break;
+		}
+		//thread를 하나도 못 만들었으면 여기서 직접 돌린다
+		if(nr_started == 0)
+			parallel_worker(&p);
+		for(int i = 0; i < nr_started; i++)
+			pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&p.lock);
+		free(threads);
+	}
+#else
+	parallel_worker(&p);
+#endif
+
+	printf("%6s %8s %6s %-8s %14s %14s %10s %8s\n",
+			"words", "blocks", "ways", "policy", "hits", "misses", "miss rate", "AMAT");
+	for(int i = 0; i < p.nr_jobs; i++)
+	{
+		struct parallel_job *job = &p.jobs[i];
+		struct cache *c = &job->cache;
+		unsigned long long nr_accesses = c->hits + c->misses;
+
+		if(job->failed)
+		{
+			fprintf(stderr, "Invalid record in %s\n", filename);
+			break;
+		}
+		printf("%6d %8d %6d %-8s %14llu %14llu %9.2f%% %8.2f\n",
+				c->nr_words_per_block, c->nr_blocks, c->nr_ways, c->policy->name, c->hits, c->misses,
+				nr_accesses ? 100.0 * c->misses / nr_accesses : 0.0,
+				nr_accesses ? (double)job->cycles / nr_accesses : 0.0);
+	}
+	unmap_trace(p.trace, p.size);
+	ret = 0;
+
+out:
+	for(int i = 0; i < p.nr_jobs; i++)
+		free_cache(&p.jobs[i].cache);
+	free(p.jobs);
+	fclose(input);
+	return ret;
+}
+
+
+/**************************************************************************
+ * Partitioned simulation
+ *
+ * DESCRIPTION
+ *   'partition' command simulates the L1 cache over a trace on several
+ *   threads. A set never touches the blocks of the other sets, so the sets
+ *   are split into as many ranges as the workers, and each worker simulates
+ *   its range in a cache of its own with the sets of the range only. The
+ *   calling thread reads the trace and hands each access to the worker of
+ *   its set through a single-producer single-consumer ring, published in
+ *   batches of PARTITION_BATCH accesses so that the reader and the workers
+ *   rarely touch the same cache lines. The counters are summed at the end.
+ *
+ *   Since an access takes the same time whatever the other sets hold, the
+ *   results equal those of 'trace' command on a fresh cache, except for the
+ *   random policies which draw different numbers on each worker. A prefetcher,
+ *   the miss classification, a write buffer, and the levels below look
+ *   across the sets, so only a single level without them can be partitioned.
+ *   The workers are only available on POSIX systems; otherwise the accesses
+ *   are simulated on the calling thread.
+ */
+#define MAX_PARTITIONS		64
+#define PARTITION_QUEUE_SIZE	(1 << 16)	/* Accesses in a ring. Power of two */
+#define PARTITION_BATCH		256
+
+struct queued_access {
+	unsigned int addr;
+	bool write;
+};
+
+struct partition {
+	struct cache cache;
+	unsigned long long cycles;
+#ifndef _WIN32
+	pthread_t thread;
+
+	/* The ring. The fields written by the reader and by the worker are
+	 * padded apart not to share a cache line */
+	char reader_line[64];
+	struct queued_access *queue;
+	size_t tail;				/* Private to the reader */
+	atomic_size_t published;	/* Accesses ready to take */
+	atomic_bool done;			/* No more accesses will be published */
+	char worker_line[64];
+	atomic_size_t head;			/* Next access to take */
+#else
+	struct queued_access *queue;
+#endif
+};
+
+static inline void partition_access(struct partition *p, unsigned int addr, bool write)
+{
+	unsigned int block, latency = 0;
+
+	access_level(&p->cache, addr, write, &block, &latency);
+	p->cycles += latency;
+}
+
+#ifndef _WIN32
+static void *partition_worker(void *arg)
+{
+	struct partition *p = arg;
+	size_t head = 0;
+
+	while(true)
+	{
+		size_t published = atomic_load_explicit(&p->published, memory_order_acquire);
+
+		if(head == published)
+		{
+			//reader가 끝났고 남은 것도 없으면 그만둔다
+			if(atomic_load_explicit(&p->done, memory_order_acquire) &&
+					head == atomic_load_explicit(&p->published, memory_order_acquire))
+				return NULL;
+			sched_yield();
+			continue;
+		}
+		for(; head != published; head++)
+		{
+			struct queued_access *a = &p->queue[head & (PARTITION_QUEUE_SIZE - 1)];
+
+			partition_access(p, a->addr, a->write);
+		}
+		atomic_store_explicit(&p->head, head, memory_order_release);
+	}
+}
+
+/* Queue an access for @p, waiting while the ring is full */
+static void queue_access(struct partition *p, unsigned int addr, bool write)
+{
+	struct queued_access *a;
+
+	while(p->tail - atomic_load_explicit(&p->head, memory_order_acquire) == PARTITION_QUEUE_SIZE)
+	{
+		atomic_store_explicit(&p->published, p->tail, memory_order_release);
+		sched_yield();
+	}
+	a = &p->queue[p->tail & (PARTITION_QUEUE_SIZE - 1)];
+	a->addr = addr;
+	a->write = write;
+	if(++p->tail % PARTITION_BATCH == 0)
+		atomic_store_explicit(&p->published, p->tail, memory_order_release);
+}
+#endif
+
+/**************************************************************************
+ * simulate_partitioned(filename, nr_threads)
+ *
+ * DESCRIPTION
+ *   Simulate the L1 cache over the trace @filename with the sets split
+ *   over @nr_threads workers (the number of processors if 0), and report
+ *   the hits, misses, and cycles with the share of each worker.
+ *
+ * RETURN
+ *   0 on success, -1 on failure
+ */
+static int simulate_partitioned(const char *filename, int nr_threads)
+{
+	struct partition *parts;
+	const unsigned char *trace, *record, *end;
+	size_t size;
+	unsigned int addr, set_shift, range_mask;
+	unsigned long long hits = 0, misses = 0, total_cycles = 0;
+	struct timespec start, finish;
+	double seconds;
+	int nr_parts = 1, nr_started = 0, op, ret = -1;
+	bool failed = false;
+
+	if(nr_levels > 1 || cache.prefetcher || cache.classify || cache.nr_write_entries)
+	{
+		printf("Only a single level without a prefetcher, -c, and a write buffer can be partitioned\n");
+		return -1;
+	}
+#ifndef _WIN32
+	if(nr_threads < 1)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	//set 범위는 2의 거듭제곱 개로 나눈다
+	while(nr_parts * 2 <= nr_threads && nr_parts * 2 <= cache.nr_sets && nr_parts < MAX_PARTITIONS)
+		nr_parts *= 2;
+
+	parts = calloc(nr_parts, sizeof(*parts));
+	if(parts == NULL)
+		return -1;
+	for(int i = 0; i < nr_parts; i++)
+	{
+		struct cache *c = &parts[i].cache;
+
+		c->nr_words_per_block = cache.nr_words_per_block;
+		c->nr_blocks = cache.nr_blocks / nr_parts;
+		c->nr_ways = cache.nr_ways;
+		c->hit_cycles = cache.hit_cycles;
+		c->policy = cache.policy;
+		c->write_through = cache.write_through;
+		c->no_write_allocate = cache.no_write_allocate;
+		c->timed_writes = cache.timed_writes;
+		setup_cache(c, cache.name, 1);
+		parts[i].queue = malloc(sizeof(*parts[i].queue) * PARTITION_QUEUE_SIZE);
+		if(alloc_cache(c, false) || parts[i].queue == NULL)
+			goto out;
+	}
+	//set index의 윗 bit가 worker를 고른다. worker의 cache는 그 bit를 빼고 본다.
+	set_shift = parts[0].cache.tag_shift;
+	range_mask = (1u << set_shift) - 1;
+
+	trace = map_trace(filename, &size);
+	if(trace == NULL)
+	{
+		perror("Trace file error");
+		goto out;
+	}
+
+	timespec_get(&start, TIME_UTC);
+#ifndef _WIN32
+	for(; nr_parts > 1 && nr_started < nr_parts; nr_started++)
+	{
+		if(pthread_create(&parts[nr_started].thread, NULL, partition_worker, &parts[nr_started]))
+			break;
+	}
+	//worker를 다 만들지 못했으면 여기서 차례로 돌린다
+	if(nr_started < nr_parts)
+	{
+		for(int i = 0; i < nr_started; i++)
+		{
+			atomic_store_explicit(&parts[i].done, true, memory_order_release);
+			pthread_join(parts[i].thread, NULL);
+		}
+		nr_started = 0;
+	}
+#endif
+	for(record = trace, end = trace + size; record < end; )
+	{
+		unsigned int i, local;
+		bool write;
+
+		if((op = next_record(&record, end, &addr)) < 0)
+		{
+			failed = true;
+			break;
+		}
+		write = TRACE_OP(op) == TRACE_STORE;
+		i = (addr >> set_shift) & (nr_parts - 1);
+		local = ((addr >> cache.tag_shift) << set_shift) | (addr & range_mask);
+#ifndef _WIN32
+		if(nr_started)
+		{
+			queue_access(&parts[i], local, write);
+			continue;
+		}
+#endif
+		partition_access(&parts[i], local, write);
+	}
+#ifndef _WIN32
+	for(int i = 0; i < nr_started; i++)
+	{
+		atomic_store_explicit(&parts[i].published, parts[i].tail, memory_order_release);
+		atomic_store_explicit(&parts[i].done, true, memory_order_release);
+	}
+	for(int i = 0; i < nr_started; i++)
+		pthread_join(parts[i].thread, NULL);
+#endif
+	timespec_get(&finish, TIME_UTC);
+	seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+	unmap_trace(trace, size);
+	if(failed)
+		fprintf(stderr, "Invalid record in %s\n", filename);
+
+	printf("%6s %14s %14s %16s\n", "sets", "hits", "misses", "cycles");
+	for(int i = 0; i < nr_parts; i++)
+	{
+		struct cache *c = &parts[i].cache;
+
+		printf("%6d %14llu %14llu %16llu\n", c->nr_sets, c->hits, c->misses, parts[i].cycles);
+		hits += c->hits;
+		misses += c->misses;
+		total_cycles += parts[i].cycles;
+	}
+	printf("%llu records in %.3f s (%.2f M records/s) on %d thread(s)\n", hits + misses, seconds,
+			seconds > 0 ? (hits + misses) / seconds / 1e6 : 0.0, nr_started ? nr_started : 1);
+	printf("hits %llu  misses %llu  cycles %llu\n", hits, misses, total_cycles);
+	ret = failed ? -1 : 0;
+
+out:
+	for(int i = 0; i < nr_parts; i++)
+	{
+		free_cache(&parts[i].cache);
+		free(parts[i].queue);
+	}
+	free(parts);
+	return ret;
+}
+
+
+/**************************************************************************
+ * Coherence
+ *
+ * DESCRIPTION
+ *   'coherence' command simulates a private cache for each core, all in the
+ *   geometry and the replacement policy of @cache, kept coherent by an
+ *   invalidation protocol. The accesses come from a trace of which the
+ *   records carry the core IDs (see 'Trace replay'). The protocols are
+ *
+ *   msi   : Modified, Shared, and Invalid
+ *   mesi  : MSI + Exclusive. A block read with no other copies is filled
+ *           as E, and can be written without asking the others
+ *   moesi : MESI + Owned. A modified block read by another core is not
+ *           written back but stays dirty as O, supplying the readers
+ *
+ *   and the caches are connected by
+ *
+ *   bus       : A snooping bus. Every miss, upgrade, and write-back is a
+ *               transaction, and the other caches snoop every transaction
+ *   directory : A full-map directory at the memory. A request goes to the
+ *               directory, which asks only the owner or the sharers. The
+ *               traffic is counted in point-to-point messages
+ *
+ *   A miss on a block that another core has invalidated is a coherence
+ *   miss. The invalidated copy keeps its tag with the state I until its way
+ *   is reused, so such misses are recognized by the tag.
+ *
+ *   The lines involved in invalidations or cache-to-cache transfers are
+ *   tracked from then on, recording which words each core reads and
+ *   writes. The hottest of them are reported, and a line is marked as
+ *   false sharing if no core touches the words written by the others.
+ */
+#define MAX_CORES			16
+#define TRANSFER_CYCLES		20		/* Clock cycles for a block sent from another cache */
+#define NR_HOT_LINES		10
+
+enum coherence_states {
+	STATE_I = 0,
+	STATE_S,
+	STATE_E,
+	STATE_O,
+	STATE_M,
+};
+
+enum coherence_protocols {
+	PROTOCOL_MSI = 0,
+	PROTOCOL_MESI,
+	PROTOCOL_MOESI,
+};
+
+static const char * const protocol_names[] = {
+	[PROTOCOL_MSI] = "msi",
+	[PROTOCOL_MESI] = "mesi",
+	[PROTOCOL_MOESI] = "moesi",
+};
+
+struct core {
+	struct cache cache;
+	unsigned char *states;		/* Coherence state of each block. One of STATE_* */
+
+	unsigned long long loads;
+	unsigned long long stores;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long coherence_misses;
+	unsigned long long upgrades;		/* Stores to S or O blocks */
+	unsigned long long invalidated;		/* Blocks invalidated by the others */
+	unsigned long long cycles;
 };
 
-/* An 1-D array for cache blocks. */
-static struct cache_block *cache = NULL;
+struct shared_line {
+	unsigned int block;			/* Block number + 1. 0 if the slot is empty */
+	unsigned long long invalidations;
+	unsigned long long transfers;
+	unsigned int read_words[MAX_CORES];		/* Bitmap of the words read by each core */
+	unsigned int written_words[MAX_CORES];
+};
 
-/* The size of cache block. The value is set during the initialization */
-static int nr_words_per_block = 4;
+struct coherence {
+	int protocol;
+	bool directory;
+	int nr_cores;
+	struct core cores[MAX_CORES];
 
-/* Number of cache blocks. The value is set during the initialization */
-static int nr_blocks = 16;
+	unsigned long long transactions;	/* Bus transactions or directory messages */
+	unsigned long long probes;			/* Lookups in the caches of the other cores */
+	unsigned long long invalidations;
+	unsigned long long transfers;		/* Blocks sent from cache to cache */
+	unsigned long long writebacks;
 
-/* Number of ways for the cache. Note @nr_ways == 1 means the direct mapped
- * cache and @nr_ways == nr_blocks implies the fully associative cache */
-static int nr_ways = 2;
+	/* Open-addressing hash table of the lines tracked */
+	struct shared_line *lines;
+	size_t lines_mask;
+	size_t nr_lines;
+};
 
-/* Number of @nr_ways-way sets in the cache. This value will be set according to
- * @nr_blocks and @nr_ways values */
-static int nr_sets = 8;
+/**************************************************************************
+ * find_line(co, block, create)
+ *
+ * DESCRIPTION
+ *   Find the line of @block in @co. Start tracking @block if @create is set.
+ *
+ * RETURN
+ *   The line. NULL if @block is not tracked or out of memory
+ */
+static struct shared_line *find_line(struct coherence *co, unsigned int block, bool create)
+{
+	size_t i;
 
-/* Clock cycles */
-const int cycles_hit = 1;
-const int cycles_miss = 100;
+	if(co->lines == NULL)
+		return NULL;
+	for(i = hash_block(block) & co->lines_mask; co->lines[i].block; i = (i + 1) & co->lines_mask)
+	{
+		if(co->lines[i].block == block + 1)
+			return &co->lines[i];
+	}
+	if(!create)
+		return NULL;
+
+	//반 이상 차면 두 배로 늘린다
+	if((co->nr_lines + 1) * 2 > co->lines_mask)
+	{
+		size_t mask = co->lines_mask * 2 + 1;
+		struct shared_line *lines = calloc(mask + 1, sizeof(*lines));
 
-int tag_bit = 0; //tag를 계산할 때 버려야 하는 bit수.
-int index_bit = 0; // index를 계산할 때 버려야 하는 bit 수.
+		if(lines == NULL)
+			return NULL;
+		for(size_t j = 0; j <= co->lines_mask; j++)
+		{
+			size_t k;
 
-/* Elapsed clock cycles so far */
-static unsigned int cycles = 0;
+			if(co->lines[j].block == 0)
+				continue;
+			for(k = hash_block(co->lines[j].block - 1) & mask; lines[k].block; k = (k + 1) & mask)
+				;
+			lines[k] = co->lines[j];
+		}
+		free(co->lines);
+		co->lines = lines;
+		co->lines_mask = mask;
+		for(i = hash_block(block) & mask; lines[i].block; i = (i + 1) & mask)
+			;
+	}
+	co->nr_lines++;
+	co->lines[i].block = block + 1;
+	return &co->lines[i];
+}
+
+/* Whether the cores touch only the words that the others do not write */
+static bool is_false_sharing(const struct coherence *co, const struct shared_line *l)
+{
+	int nr_sharers = 0;
 
+	for(int i = 0; i < co->nr_cores; i++)
+	{
+		unsigned int others = 0;
 
-/**
- * strmatch()
+		if(l->read_words[i] | l->written_words[i])
+			nr_sharers++;
+		for(int j = 0; j < co->nr_cores; j++)
+		{
+			if(j != i)
+				others |= l->written_words[j];
+		}
+		if((l->read_words[i] | l->written_words[i]) & others)
+			return false;
+	}
+	return nr_sharers > 1;
+}
+
+/* Index of the valid block containing @addr in @c of @core. -1 if none */
+static inline int find_copy(struct core *core, unsigned int addr)
+{
+	int b = find_block(&core->cache, addr);
+
+	return b >= 0 && core->states[b] != STATE_I ? b : -1;
+}
+
+/**************************************************************************
+ * invalidate_copies(co, id, addr)
  *
  * DESCRIPTION
- *   Compare strings @str and @expect and return 1 if they are the same.
- *   You may use this function to simplify string matching :)
+ *   Invalidate the copies of the block containing @addr in the caches of
+ *   the cores other than @id.
  *
  * RETURN
- *   1 if @str and @expect are the same
- *   0 otherwise
+ *   The number of the copies invalidated
  */
-static inline bool strmatch(char * const str, const char *expect)
+static int invalidate_copies(struct coherence *co, int id, unsigned int addr)
 {
-    return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
+	int nr_invalidated = 0;
+
+	for(int i = 0; i < co->nr_cores; i++)
+	{
+		int b;
+
+		if(i == id)
+			continue;
+		b = find_copy(&co->cores[i], addr);
+		if(b < 0)
+			continue;
+		//tag는 남겨 두어야 나중에 coherence miss인지 알 수 있다
+		co->cores[i].states[b] = STATE_I;
+		co->cores[i].invalidated++;
+		nr_invalidated++;
+	}
+	co->invalidations += nr_invalidated;
+	return nr_invalidated;
 }
 
-/**
- * log2_discrete
+/**************************************************************************
+ * coherent_access(co, id, addr, write)
  *
  * DESCRIPTION
- *   Return the integer part of log_2(@n). FREE TO USE IN YOUR IMPLEMENTATION.
- *   Will be useful for calculating the length of tag for a given address.
+ *   Simulate the access of core @id to @addr in @co.
  */
-static int log2_discrete(int n)
+static void coherent_access(struct coherence *co, int id, unsigned int addr, bool write)
 {
-	int result = -1;
-	do {
-		n = n >> 1;
-		result++;
-	} while (n);
+	struct core *me = &co->cores[id];
+	struct cache *c = &me->cache;
+	unsigned int set = (addr >> c->index_shift) & c->index_mask;
+	unsigned int first = set * c->nr_ways;
+	unsigned int block = addr >> c->index_shift;
+	unsigned int word = 1u << ((addr & c->offset_mask) / BYTES_PER_WORD);
+	int way = find_way(&c->tags[first], c->nr_ways, addr >> c->tag_shift);
+	int state = way >= 0 ? me->states[first + way] : STATE_I;
+	int nr_invalidated = 0, owner = -1;
+	bool shared = false, transferred = false;
+	struct shared_line *line;
 
-	return result;
+	if(write)
+		me->stores++;
+	else
+		me->loads++;
+
+	if(state != STATE_I)
+	{
+		me->hits++;
+		c->policy->hit(c, set, way);
+		me->cycles += c->hit_cycles;
+
+		//S나 O에 쓰려면 다른 copy를 모두 invalidate해야 한다
+		if(write && (state == STATE_S || state == STATE_O))
+		{
+			me->upgrades++;
+			co->probes += co->directory ? 0 : co->nr_cores - 1;
+			nr_invalidated = invalidate_copies(co, id, addr);
+			co->probes += co->directory ? nr_invalidated : 0;
+			co->transactions += co->directory ? 2 + 2 * nr_invalidated : 1;
+			me->cycles += TRANSFER_CYCLES;
+		}
+		if(write)
+			me->states[first + way] = STATE_M;
+		goto track;
+	}
+
+	me->misses++;
+	if(way >= 0)
+		me->coherence_misses++;
+
+	//다른 core의 copy를 찾는다. M, O, E 인 core가 owner
+	for(int i = 0; i < co->nr_cores; i++)
+	{
+		int b;
+
+		if(i == id || (b = find_copy(&co->cores[i], addr)) < 0)
+			continue;
+		shared = true;
+		if(co->cores[i].states[b] >= STATE_E)
+			owner = i;
+	}
+	if(!co->directory)
+		co->probes += co->nr_cores - 1;
+
+	if(owner >= 0)
+	{
+		struct core *o = &co->cores[owner];
+		int b = find_copy(o, addr);
+
+		//dirty한 block은 owner가 직접 보낸다
+		if(o->states[b] == STATE_M || o->states[b] == STATE_O)
+		{
+			co->transfers++;
+			transferred = true;
+			me->cycles += TRANSFER_CYCLES;
+		}
+		else
+			me->cycles += memory_cycles;
+
+		if(!write && o->states[b] == STATE_M)
+		{
+			if(co->protocol == PROTOCOL_MOESI)
+				o->states[b] = STATE_O;
+			else
+			{
+				//MSI, MESI는 memory에 써 두고 S가 된다
+				o->states[b] = STATE_S;
+				co->writebacks++;
+				co->transactions++;
+			}
+		}
+		else if(!write && o->states[b] == STATE_E)
+			o->states[b] = STATE_S;
+		if(co->directory)
+		{
+			co->probes++;
+			co->transactions += 2;
+		}
+	}
+	else
+	{
+		me->cycles += memory_cycles;
+		if(co->directory)
+			co->transactions++;
+	}
+
+	if(write)
+	{
+		nr_invalidated = invalidate_copies(co, id, addr);
+		if(co->directory)
+		{
+			co->probes += nr_invalidated;
+			co->transactions += 2 * nr_invalidated;
+		}
+	}
+	//directory에는 요청 하나, bus에는 transaction 하나
+	co->transactions++;
+
+	//무효화된 tag가 있으면 그 자리를, 없으면 빈 자리나 victim을 쓴다
+	if(way < 0)
+	{
+		for(int w = 0; w < c->nr_ways; w++)
+		{
+			if(me->states[first + w] == STATE_I)
+			{
+				way = w;
+				break;
+			}
+		}
+	}
+	if(way < 0)
+	{
+		way = c->policy->victim(c, set);
+		if(me->states[first + way] == STATE_M || me->states[first + way] == STATE_O)
+		{
+			co->writebacks++;
+			co->transactions++;
+		}
+	}
+	c->tags[first + way] = addr >> c->tag_shift;
+	c->valid[first + way] = CB_VALID;
+	if(write)
+		me->states[first + way] = STATE_M;
+	else if(shared || co->protocol == PROTOCOL_MSI)
+		me->states[first + way] = STATE_S;
+	else
+		me->states[first + way] = STATE_E;
+	c->policy->fill(c, set, way);
+
+track:
+	line = find_line(co, block, nr_invalidated > 0 || transferred);
+	if(line == NULL)
+		return;
+	line->invalidations += nr_invalidated;
+	if(transferred)
+		line->transfers++;
+	if(write)
+		line->written_words[id] |= word;
+	else
+		line->read_words[id] |= word;
 }
-/*          ****** DO NOT MODIFY ANYTHING UP TO THIS LINE ******      */
-/*====================================================================*/
 
+static int compare_lines(const void *a, const void *b)
+{
+	const struct shared_line *x = a, *y = b;
+	unsigned long long nx = x->invalidations + x->transfers, ny = y->invalidations + y->transfers;
+
+	return nx < ny ? 1 : (nx > ny ? -1 : 0);
+}
 
 /**************************************************************************
- * load_word(addr)
+ * simulate_coherence(filename, nr_cores, protocol, interconnect)
  *
  * DESCRIPTION
- *   Simulate the case when the processor is handling a lw instruction for @addr.
- *   To that end, you should first look up the cache blocks to find the block
- *   containing the target address @addr. If exists, it's cache hit; return
- *   CACHE_HIT after updating the cache block's timestamp with @cycles.
- *   Otherwise, replace the LRU cache block in the set. Should handle dirty
- *   blocks properly according to the write-back semantic.
- *
- * PARAMETERS
- *   @addr: Target address to load
+ *   Simulate @nr_cores coherent caches with @protocol over @interconnect
+ *   ("bus" or "directory") for the trace @filename, and report the results.
  *
  * RETURN
- *   CACHE_HIT on cache hit, CACHE_MISS otherwise
- *
+ *   0 on success, -1 on failure
  */
-int load_word(unsigned int addr)
+static int simulate_coherence(const char *filename, int nr_cores, const char *protocol, const char *interconnect)
 {
-	/* TODO: Implement your load_word function */
-	int cache_tag = 0;
-	int cache_set = 0;
-
-	if(nr_sets < 1)
-		nr_sets = 1;
-	cache_tag = addr >> tag_bit;
-	//cache의 몇 번째 set인지
-	cache_set = (addr >> index_bit) % nr_sets;
-	printf("%0x\n",addr);
-
-	for(int i = cache_set * nr_ways; i < (cache_set + 1) * nr_ways; i++)
-	{
-		//사용가능한지 여부확인.
-		if(cache[i].valid == 0)
-		{
-			addr = (addr >> index_bit) << index_bit;
-	printf("%0x\n",addr);
-			cache[i].valid = true;
-			cache[i].tag = cache_tag;
-			cache[i].timestamp = cycles;
-			for(int j = 0; j < nr_words_per_block * BYTES_PER_WORD; j++)
-				cache[i].data[j] = memory[addr + j];
-		return CACHE_MISS;
+	struct coherence *co;
+	const unsigned char *trace, *record, *end;
+	size_t size;
+	unsigned int addr;
+	int op, ret = -1;
+
+	if(nr_cores < 1 || nr_cores > MAX_CORES ||
+			(!strmatch((char *)interconnect, "bus") && !strmatch((char *)interconnect, "directory")))
+	{
+		printf("Wrong input for coherence\n");
+		return -1;
+	}
+	co = calloc(1, sizeof(*co));
+	if(co == NULL)
+		return -1;
+	co->protocol = -1;
+	for(size_t i = 0; i < sizeof(protocol_names) / sizeof(*protocol_names); i++)
+	{
+		if(strmatch((char *)protocol, protocol_names[i]))
+			co->protocol = i;
+	}
+	if(co->protocol < 0)
+	{
+		printf("Unknown protocol %s\n", protocol);
+		free(co);
+		return -1;
+	}
+	co->directory = strmatch((char *)interconnect, "directory");
+	co->nr_cores = nr_cores;
+	co->lines_mask = 1023;
+	co->lines = calloc(co->lines_mask + 1, sizeof(*co->lines));
+
+	for(int i = 0; i < nr_cores; i++)
+	{
+		struct cache *c = &co->cores[i].cache;
+
+		c->nr_words_per_block = nr_words_per_block;
+		c->nr_blocks = nr_blocks;
+		c->nr_ways = nr_ways;
+		c->hit_cycles = cycles_hit;
+		setup_cache(c, "", 1);
+		co->cores[i].states = calloc(nr_blocks, sizeof(*co->cores[i].states));
+		if(alloc_cache(c, false) || co->cores[i].states == NULL)
+			goto out;
+	}
+
+	trace = map_trace(filename, &size);
+	if(trace == NULL)
+	{
+		perror("Trace file error");
+		goto out;
+	}
+	for(record = trace, end = trace + size; record < end; )
+	{
+		if((op = next_record(&record, end, &addr)) < 0 || TRACE_CORE(op) >= nr_cores)
+		{
+			fprintf(stderr, "Invalid record in %s\n", filename);
+			break;
 		}
+		coherent_access(co, TRACE_CORE(op), addr, TRACE_OP(op) == TRACE_STORE);
 	}
-	return CACHE_MISS;
+	unmap_trace(trace, size);
+
+	printf("%s, %d cores over a %s\n", protocol_names[co->protocol], nr_cores, co->directory ? "directory" : "snooping bus");
+	printf("core %12s %12s %12s %12s %12s %12s %12s %14s\n",
+			"loads", "stores", "hits", "misses", "coherence", "upgrades", "invalidated", "cycles");
+	for(int i = 0; i < nr_cores; i++)
+	{
+		struct core *core = &co->cores[i];
+
+		printf("%4d %12llu %12llu %12llu %12llu %12llu %12llu %12llu %14llu\n", i, core->loads, core->stores,
+				core->hits, core->misses, core->coherence_misses, core->upgrades, core->invalidated, core->cycles);
+	}
+	printf("%s %llu  probes %llu  invalidations %llu  cache-to-cache transfers %llu  write-backs %llu\n",
+			co->directory ? "messages" : "bus transactions", co->transactions, co->probes,
+			co->invalidations, co->transfers, co->writebacks);
+
+	//가장 많이 오간 line들
+	if(co->lines && co->nr_lines)
+	{
+		size_t n = 0;
+
+		for(size_t i = 0; i <= co->lines_mask; i++)
+		{
+			if(co->lines[i].block)
+				co->lines[n++] = co->lines[i];
+		}
+		qsort(co->lines, n, sizeof(*co->lines), compare_lines);
+
+		printf("\nHot lines\n");
+		printf("%10s %14s %14s %6s  %s\n", "address", "invalidations", "transfers", "cores", "sharing");
+		for(size_t i = 0; i < n && i < NR_HOT_LINES; i++)
+		{
+			struct shared_line *l = &co->lines[i];
+			int nr_sharers = 0;
+
+			for(int j = 0; j < nr_cores; j++)
+			{
+				if(l->read_words[j] | l->written_words[j])
+					nr_sharers++;
+			}
+			printf("0x%08x %14llu %14llu %6d  %s\n", (l->block - 1) << co->cores[0].cache.index_shift,
+					l->invalidations, l->transfers, nr_sharers, is_false_sharing(co, l) ? "false" : "true");
+		}
+	}
+	ret = 0;
+
+out:
+	for(int i = 0; i < nr_cores; i++)
+	{
+		free_cache(&co->cores[i].cache);
+		free(co->cores[i].states);
+	}
+	free(co->lines);
+	free(co);
+	return ret;
 }
+#endif
+
 
 
 /**************************************************************************
- * store_word(addr, data)
+ * Cache model library
  *
  * DESCRIPTION
- *   Simulate the case when the processor is handling the 'sw' instruction.
- *   Cache should be write-back and write-allocate. Note that the least
- *   recently used (LRU) block should be replaced in case of eviction.
+ *   Built with -DCACHE_SIM_LIBRARY, this file leaves out the command
+ *   interpreter, the trace commands, and main(), and can be linked into
+ *   other programs as their cache model. For example, pa2.c uses it when built with
+ *   -DUSE_CACHE_MODEL;
  *
- * PARAMETERS
- *   @addr: Starting address for @data
- *   @data: New value for @addr. Assume that @data is 1-word in size
+ *     gcc -c -DCACHE_SIM_LIBRARY pa3.c
+ *     gcc -DUSE_CACHE_MODEL pa2.c pa3.o -o pa2
+ *
+ *   The program sets the model up with @init_cache_model() and calls
+ *   @load_word(), @store_word(), and @fetch_word() for its accesses. The
+ *   program keeps its own memory, so the model is always dataless.
+ */
+
+/**************************************************************************
+ * parse_options(argc, argv)
+ *
+ * DESCRIPTION
+ *   Apply the options in @argv. See @__usage() for the options.
  *
  * RETURN
- *   CACHE_HIT on cache hit, CACHE_MISS otherwise
+ *   The index of the first argument that is not an option
+ *   -1 if an option is wrong
+ */
+static int parse_options(int argc, const char *argv[])
+{
+	int i;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(strmatch((char *)argv[i], "-n"))
+			dataless = true;
+		else if(strmatch((char *)argv[i], "-r") && i + 1 < argc && find_policy(argv[i + 1]))
+			policy = find_policy(argv[++i]);
+		else if(strmatch((char *)argv[i], "-i") && i + 1 < argc && !parse_level(argv[i + 1], &icache))
+			i++;
+		else if(strmatch((char *)argv[i], "-l") && i + 1 < argc && nr_lower_levels < MAX_LEVELS - 2 &&
+				!parse_level(argv[i + 1], &lower_levels[nr_lower_levels]))
+		{
+			nr_lower_levels++;
+			i++;
+		}
+		else if(strmatch((char *)argv[i], "-p") && i + 1 < argc && !parse_prefetcher(argv[i + 1]))
+			i++;
+		else if(strmatch((char *)argv[i], "-w") && i + 1 < argc && !parse_write_policy(argv[i + 1]))
+			i++;
+		else if(strmatch((char *)argv[i], "-c"))
+			classify_misses = true;
+		else if(strmatch((char *)argv[i], "-v") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			nr_victims = atoi(argv[++i]);
+		else if(strmatch((char *)argv[i], "-m") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			memory_cycles = atoi(argv[++i]);
+		else
+			return -1;
+	}
+	return i;
+}
+
+/**************************************************************************
+ * reset_cache_model
  *
+ * DESCRIPTION
+ *   Empty all the levels of the model, and clear the statistics and @cycles.
+ *
+ * RETURN
+ *   0 on success, -1 if out of memory
  */
-int store_word(unsigned int addr, unsigned int data)
+int reset_cache_model(void)
 {
-	/* TODO: Implement your store_word function */
+	cycles = 0;
+	for(int i = 0; i < nr_levels; i++)
+	{
+		struct cache *c = levels[i];
 
-	return CACHE_MISS;
+		free_cache(c);
+		c->hits = c->misses = c->writebacks = c->back_invalidations = 0;
+		c->prefetches = c->useful_prefetches = c->late_prefetches = 0;
+		c->useless_prefetches = c->polluting_misses = 0;
+		memset(c->misses_by_kind, 0x00, sizeof(c->misses_by_kind));
+		memset(c->recovered, 0x00, sizeof(c->recovered));
+		c->pending_stall = c->write_stalls = c->bytes_read = c->bytes_written = 0;
+		if(alloc_cache(c, !dataless))
+		{
+			fprintf(stderr, "Unable to allocate %s\n", c->name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void fini_cache_model(void)
+{
+	for(int i = 0; i < nr_levels; i++)
+	{
+		free_cache(levels[i]);
+	}
+	nr_levels = 0;
+}
+
+/* Clock cycles taken by the accesses since the model is reset */
+unsigned long long cache_model_cycles(void)
+{
+	return cycles;
 }
 
+void report_cache_model(void)
+{
+	print_stats();
+}
 
 /**************************************************************************
- * init_simulator
+ * init_cache_model(argc, argv)
  *
  * DESCRIPTION
- *   This function is called before starting the simulation. This is the
- *   perfect place to put your initialization code. You may leave this function
- *   empty if you'd like.
+ *   Set up the model from @argv, which has the options of this simulator
+ *   followed by the number of words per block, the number of blocks, and
+ *   the number of ways of L1. @argv[0] is not used like the one of main().
+ *   The model set up before is thrown away.
+ *
+ * RETURN
+ *   0 on success, -1 if @argv is wrong or out of memory
  */
-void init_simulator(void)
+int init_cache_model(int argc, const char *argv[])
 {
-	/* TODO: You may place your initialization code here */
-	tag_bit = log2_discrete(nr_blocks) + log2_discrete(BYTES_PER_WORD);
-	index_bit = log2_discrete(nr_words_per_block) + log2_discrete(BYTES_PER_WORD);
-	printf("tag_bit : %d, index_bit : %d\n", tag_bit, index_bit);
+	int i;
+
+	fini_cache_model();
+	memset(&cache, 0x00, sizeof(cache));
+	memset(&icache, 0x00, sizeof(icache));
+	memset(&victim_cache, 0x00, sizeof(victim_cache));
+	memset(lower_levels, 0x00, sizeof(lower_levels));
+	nr_lower_levels = 0;
+	memory_cycles = 0;
+	policy = NULL;
+	prefetcher = NULL;
+	classify_misses = false;
+	nr_victims = 0;
+	timed_writes = write_through = no_write_allocate = false;
+	write_buffer_depth = DEFAULT_WRITE_BUFFER_DEPTH;
+
+	i = parse_options(argc, argv);
+	if(i < 0 || argc - i != 3)
+		return -1;
+	nr_words_per_block = atoi(argv[i]);
+	nr_blocks = atoi(argv[i + 1]);
+	nr_ways = atoi(argv[i + 2]);
+	if(nr_words_per_block < 1 || nr_words_per_block > MAX_NR_WORDS_PER_BLOCK ||
+			nr_ways < 1 || nr_ways > nr_blocks || check_exclusive_levels())
+		return -1;
+
+	init_simulator();
+	dataless = true;
+	return reset_cache_model();
 }
 
 
 
 /*====================================================================*/
 /*          ****** DO NOT MODIFY ANYTHING FROM THIS LINE ******       */
+#ifndef CACHE_SIM_LIBRARY
 static void __show_cache(void)
 {
 	for (int i = 0; i < nr_blocks; i++) {
-		fprintf(stderr, "[%3d] %c%c %8x %8u | ", i,
-				cache[i].valid == CB_VALID ? 'v' : ' ',
-				cache[i].dirty == CB_DIRTY ? 'd' : ' ',
-				cache[i].tag, cache[i].timestamp);
-		for (int j = 0; j < BYTES_PER_WORD * nr_words_per_block; j++) {
-			fprintf(stderr, "%02x", cache[i].data[j]);
+		fprintf(stderr, "[%3d] %c%c %8x %8llu | ", i,
+				cache.valid[i] == CB_VALID ? 'v' : ' ',
+				cache.dirty[i] == CB_DIRTY ? 'd' : ' ',
+				cache.valid[i] == CB_VALID ? cache.tags[i] : 0, cache.timestamps[i]);
+		for (int j = 0; cache.data && j < BYTES_PER_WORD * nr_words_per_block; j++) {
+			fprintf(stderr, "%02x", cache.data[i * cache.block_size + j]);
 			if ((j + 1) % 4 == 0) fprintf(stderr, " ");
 		}
 		fprintf(stderr, "\n");
@@ -259,22 +3446,19 @@ static void __dump_memory(unsigned int start)
 
 static void __init_cache(void)
 {
-	cache = malloc(sizeof(struct cache_block) * nr_blocks);
-
-	for (int i = 0; i < nr_blocks; i++) {
-		cache[i] = (struct cache_block) {
-			.valid = CB_INVALID,
-			.dirty = CB_CLEAN,
-			.tag = 0,
-			.timestamp = 0,
-			.data = { 0x00 },
-		};
+	for (int i = 0; i < nr_levels; i++) {
+		if (alloc_cache(levels[i], !dataless)) {
+			fprintf(stderr, "Unable to allocate %s\n", levels[i]->name);
+			exit(EXIT_FAILURE);
+		}
 	}
 }
 
 static void __fini_cache(void)
 {
-	free(cache);
+	for (int i = 0; i < nr_levels; i++) {
+		free_cache(levels[i]);
+	}
 }
 
 static int __parse_command(char *command, int *nr_tokens, char *tokens[])
@@ -321,7 +3505,7 @@ static void __simulate_cache(FILE *input)
 	char *argv[10];
 	char command[80];
 
-	unsigned int hits = 0, misses = 0;
+	unsigned long long hits = 0, misses = 0;
 
 	__init_cache();
 
@@ -349,7 +3533,46 @@ static void __simulate_cache(FILE *input)
 			__dump_memory(addr);
 			continue;
 		} else if (strmatch(argv[0], "cycles")) {
-			fprintf(stderr, "%3u %3u   %u\n", hits, misses, cycles);
+			fprintf(stderr, "%3llu %3llu   %llu\n", hits, misses, cycles);
+			if (cache.shadow) print_miss_kinds();
+			continue;
+		} else if (strmatch(argv[0], "stats")) {
+			print_stats();
+			continue;
+		} else if (strmatch(argv[0], "trace")) {
+			if (argc != 2) {
+				printf("Usage: trace <trace file>\n");
+				continue;
+			}
+			replay_trace(argv[1], &hits, &misses);
+			continue;
+		} else if (strmatch(argv[0], "sweep")) {
+			if (argc != 5) {
+				printf("Usage: sweep <trace file> <words per block> <ways> <max blocks>\n");
+				continue;
+			}
+			sweep_trace(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+			continue;
+		} else if (strmatch(argv[0], "parallel")) {
+			if (argc != 3 && argc != 4) {
+				printf("Usage: parallel <trace file> <cache list> [threads]\n");
+				continue;
+			}
+			simulate_parallel(argv[1], argv[2], argc == 4 ? atoi(argv[3]) : 0);
+			continue;
+		} else if (strmatch(argv[0], "partition")) {
+			if (argc != 2 && argc != 3) {
+				printf("Usage: partition <trace file> [threads]\n");
+				continue;
+			}
+			simulate_partitioned(argv[1], argc == 3 ? atoi(argv[2]) : 0);
+			continue;
+		} else if (strmatch(argv[0], "coherence")) {
+			if (argc != 4 && argc != 5) {
+				printf("Usage: coherence <trace file> <cores> <msi|mesi|moesi> [bus|directory]\n");
+				continue;
+			}
+			simulate_coherence(argv[1], atoi(argv[2]), argv[3], argc == 5 ? argv[4] : "bus");
 			continue;
 		} else if (strmatch(argv[0], "lw")) {
 			if (argc == 1) {
@@ -368,14 +3591,32 @@ static void __simulate_cache(FILE *input)
 			addr = strtoimax(argv[1], NULL, 0);
 			value = strtoimax(argv[2], NULL, 0);
 			hit = store_word(addr, value);
+		} else if (strmatch(argv[0], "fetch")) {
+			if (argc != 2) {
+				printf("Usage: fetch <address to fetch>\n");
+				continue;
+			}
+			addr = strtoimax(argv[1], NULL, 0);
+			hit = fetch_word(addr);
 		} else if (strmatch(argv[0], "help")) {
 			printf("- show         : Show cache\n");
 			printf("- dump [addr]  : Dump memory from @addr to @addr+64\n");
 			printf("- cycles       : Show elapsed cycles\n");
+			printf("- stats        : Show hits and misses of each level\n");
 			printf("\n");
 			printf("- lw <addr>    : Simulate loading a word at @addr\n");
 			printf("- sw <addr> <value>\n");
 			printf("               : Simulate storing @value at @addr\n");
+			printf("- fetch <addr> : Simulate fetching an instruction at @addr\n");
+			printf("- trace <file> : Replay the accesses in the binary trace @file\n");
+			printf("- sweep <file> <words> <ways> <blocks>\n");
+			printf("               : Misses of LRU caches up to @ways ways and @blocks blocks\n");
+			printf("- parallel <file> <list> [threads]\n");
+			printf("               : Simulate the caches in @list over @file on threads\n");
+			printf("- partition <file> [threads]\n");
+			printf("               : Simulate the cache over @file with its sets split over threads\n");
+			printf("- coherence <file> <cores> <protocol> [bus|directory]\n");
+			printf("               : Simulate coherent private caches for the core-tagged trace @file\n");
 			printf("\n");
 		} else {
 			continue;
@@ -383,22 +3624,43 @@ static void __simulate_cache(FILE *input)
 
 		if (hit == CACHE_HIT) {
 			hits++;
-			cycles += cycles_hit;
 		} else {
 			misses++;
-			cycles += cycles_miss;
 		}
 	}
 
 	__fini_cache();
 }
 
+static void __usage(const char *name)
+{
+	printf("Usage: %s [-n] [-c] [-r policy] [-p prefetcher] [-v entries] [-w policy] [-i level] [-l level]... [-m cycles] [input file]\n", name);
+	printf("  -n        : Simulate the tags only (dataless mode)\n");
+	printf("  -c        : Classify the misses of L1 into compulsory, capacity, and conflict\n");
+	printf("  -r policy : Replacement policy. lru (default), plru, fifo, random, srrip, or brrip\n");
+	printf("  -p prefetcher[:degree]\n");
+	printf("            : Prefetcher of L1. next-line, stride, stride-pc, or stream\n");
+	printf("  -v entries: Add a fully-associative victim cache below L1\n");
+	printf("  -w policy : Write policy of L1. [back|through]{:[allocate|no-allocate]{:[write buffer depth]}}\n");
+	printf("  -i level  : Add L1 instruction cache\n");
+	printf("  -l level  : Add the next lower level (L2, L3, ...)\n");
+	printf("  -m cycles : Clock cycles to access the memory (default %d)\n", cycles_miss);
+	printf("  where level is <words per block>:<blocks>:<ways>:<hit cycles>[:inclusive|:exclusive|:nine]\n");
+}
+
 int main(int argc, const char *argv[])
 {
 	FILE *input = stdin;
+	int i;
 
-	if (argc > 1) {
-		input = fopen(argv[1], "r");
+	i = parse_options(argc, argv);
+	if (i < 0) {
+		__usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (i < argc) {
+		input = fopen(argv[i], "r");
 		if (!input) {
 			perror("Input file error");
 			return EXIT_FAILURE;
@@ -434,6 +3696,10 @@ int main(int argc, const char *argv[])
 	nr_sets = nr_blocks / nr_ways;
 #endif
 
+	if (check_exclusive_levels()) {
+		printf("An exclusive level must have the same words per block as the level above\n");
+		return EXIT_FAILURE;
+	}
 	init_simulator();
 	__simulate_cache(input);
 
@@ -441,3 +3707,4 @@ int main(int argc, const char *argv[])
 
 	return EXIT_SUCCESS;
 }
+#endif